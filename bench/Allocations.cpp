@@ -0,0 +1,96 @@
+#include "Benchmark.h"
+
+#include <stdlib.h>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace Bench {
+  AllocationCounter allocations = { false, 0, 0, 0, 0, 0 };
+
+#if defined(__GLIBC__)
+  const bool tracksLiveBytes = true;
+#else
+  const bool tracksLiveBytes = false;
+#endif
+};
+
+#if defined(__GLIBC__)
+// Interpose the C allocator so that both operator new and direct malloc calls (e.g.,
+// ArduinoJson's default allocator) are counted.  Live bytes are tracked by the usable size
+// of each block, so that frees can subtract the same amount.
+extern "C" {
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t count, size_t size);
+  void* __libc_realloc(void* ptr, size_t size);
+  void __libc_free(void* ptr);
+
+  void* malloc(size_t size) {
+    Bench::allocations.record(size);
+
+    void* ptr = __libc_malloc(size);
+    Bench::allocations.allocated(malloc_usable_size(ptr));
+    return ptr;
+  }
+
+  void* calloc(size_t count, size_t size) {
+    Bench::allocations.record(count * size);
+
+    void* ptr = __libc_calloc(count, size);
+    Bench::allocations.allocated(malloc_usable_size(ptr));
+    return ptr;
+  }
+
+  void* realloc(void* ptr, size_t size) {
+    Bench::allocations.record(size);
+
+    size_t previous = malloc_usable_size(ptr);
+    void* resized = __libc_realloc(ptr, size);
+
+    // A failed realloc leaves the original block allocated
+    if (resized != nullptr || size == 0) {
+      Bench::allocations.freed(previous);
+      Bench::allocations.allocated(malloc_usable_size(resized));
+    }
+    return resized;
+  }
+
+  void free(void* ptr) {
+    Bench::allocations.freed(malloc_usable_size(ptr));
+    __libc_free(ptr);
+  }
+}
+#else
+// Without glibc only C++ allocations can be hooked portably.
+void* operator new(size_t size) {
+  Bench::allocations.record(size);
+
+  void* ptr = malloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+#endif
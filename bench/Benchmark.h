@@ -0,0 +1,138 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+
+namespace Bench {
+  /**
+   * Counts heap allocations.  Incremented by the malloc/operator new hooks in
+   * Allocations.cpp while enabled.  lifetimeCount is always incremented, and is what
+   * RichHttp::HeapStats reads when built with RICH_HTTP_HEAP_STATS.
+   */
+  struct AllocationCounter {
+    volatile bool enabled;
+    size_t count;
+    size_t bytes;
+    volatile size_t lifetimeCount;
+
+    // Bytes currently allocated, and the most allocated at once since resetPeak().  Only
+    // tracked where frees can be hooked along with the size of the block (see
+    // tracksLiveBytes).
+    size_t liveBytes;
+    size_t peakBytes;
+
+    void reset() {
+      count = 0;
+      bytes = 0;
+    }
+
+    void resetPeak() {
+      peakBytes = liveBytes;
+    }
+
+    inline void record(size_t size) {
+      lifetimeCount = lifetimeCount + 1;
+
+      if (enabled) {
+        ++count;
+        bytes += size;
+      }
+    }
+
+    inline void allocated(size_t size) {
+      liveBytes += size;
+
+      if (liveBytes > peakBytes) {
+        peakBytes = liveBytes;
+      }
+    }
+
+    // Blocks from allocators which aren't hooked (e.g. aligned_alloc) may be freed too
+    inline void freed(size_t size) {
+      liveBytes = size < liveBytes ? liveBytes - size : 0;
+    }
+  };
+
+  extern AllocationCounter allocations;
+  extern const bool tracksLiveBytes;
+
+  struct Result {
+    const char* name;
+    size_t iterations;
+    double nsPerOp;
+    double allocationsPerOp;
+    double bytesPerOp;
+  };
+
+  // Prevents the compiler from discarding a value computed in a benchmark body.
+  template <class T>
+  inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  inline void printHeader() {
+    printf("%-48s %12s %12s %12s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op", "bytes/op");
+  }
+
+  inline void print(const Result& result) {
+    printf(
+      "%-48s %12zu %12.1f %12.2f %12.1f\n",
+      result.name,
+      result.iterations,
+      result.nsPerOp,
+      result.allocationsPerOp,
+      result.bytesPerOp
+    );
+  }
+
+  /**
+   * Runs fn repeatedly until at least minMillis have elapsed and reports the per-call
+   * time and heap activity.  Allocations are measured on a separate pass so the hooks
+   * don't skew the timings.
+   */
+  template <class Fn>
+  Result run(const char* name, Fn fn, unsigned long minMillis = 250) {
+    using Clock = std::chrono::steady_clock;
+
+    // warm up any lazily initialized state
+    for (size_t i = 0; i < 100; ++i) {
+      fn();
+    }
+
+    size_t iterations = 0;
+    size_t batch = 64;
+    Clock::duration elapsed(0);
+
+    while (elapsed < std::chrono::milliseconds(minMillis)) {
+      Clock::time_point start = Clock::now();
+      for (size_t i = 0; i < batch; ++i) {
+        fn();
+      }
+      elapsed += Clock::now() - start;
+      iterations += batch;
+      batch *= 2;
+    }
+
+    const size_t allocationIterations = 1000;
+
+    allocations.reset();
+    allocations.enabled = true;
+    for (size_t i = 0; i < allocationIterations; ++i) {
+      fn();
+    }
+    allocations.enabled = false;
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    result.allocationsPerOp = static_cast<double>(allocations.count) / allocationIterations;
+    result.bytesPerOp = static_cast<double>(allocations.bytes) / allocationIterations;
+
+    print(result);
+    return result;
+  }
+};
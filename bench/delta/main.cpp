@@ -0,0 +1,475 @@
+// Host-side harness for delta OTA patches (see src/DeltaUpdate.h).  Applies patches with
+// Delta::Patcher to file-backed stand-ins for the running sketch and the update partition,
+// and checks the result against the MD5 in the patch header, as Update does on a device.
+//
+// Build with
+//
+//   pio run -e native_delta
+//
+// Run .pio/build/native_delta/program with no arguments to run the built-in cases, or
+// apply a patch generated by tools/delta_patch.py with:
+//
+//   program <source.bin> <patch.bin> <output.bin>
+
+#include <Arduino.h>
+#include <DeltaUpdate.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+using namespace RichHttp::Delta;
+
+namespace {
+  using Bytes = std::vector<uint8_t>;
+
+  /**
+   * MD5 (RFC 1321), for checking reconstructed images the way Update does
+   */
+  class Md5 {
+    public:
+      Md5() : length(0), buffered(0) {
+        state[0] = 0x67452301;
+        state[1] = 0xefcdab89;
+        state[2] = 0x98badcfe;
+        state[3] = 0x10325476;
+      }
+
+      void add(const uint8_t* data, size_t size) {
+        length += size;
+
+        while (size > 0) {
+          size_t n = std::min(size, sizeof(block) - buffered);
+          memcpy(block + buffered, data, n);
+          buffered += n;
+          data += n;
+          size -= n;
+
+          if (buffered == sizeof(block)) {
+            transform();
+            buffered = 0;
+          }
+        }
+      }
+
+      void finish(uint8_t (&digest)[16]) {
+        uint64_t bits = length * 8;
+        uint8_t padding = 0x80;
+
+        add(&padding, 1);
+        padding = 0;
+        while (buffered != 56) {
+          add(&padding, 1);
+        }
+
+        uint8_t size[8];
+        for (size_t i = 0; i < 8; ++i) {
+          size[i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+        add(size, sizeof(size));
+
+        for (size_t i = 0; i < 16; ++i) {
+          digest[i] = static_cast<uint8_t>(state[i / 4] >> (8 * (i % 4)));
+        }
+      }
+
+    private:
+      uint32_t state[4];
+      uint64_t length;
+      uint8_t block[64];
+      size_t buffered;
+
+      static uint32_t rotate(uint32_t x, uint32_t n) {
+        return (x << n) | (x >> (32 - n));
+      }
+
+      void transform() {
+        static const uint32_t K[64] = {
+          0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+          0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+          0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+          0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+          0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+          0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+          0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+          0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+        };
+        static const uint32_t SHIFTS[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+        uint32_t words[16];
+        for (size_t i = 0; i < 16; ++i) {
+          words[i] = block[4*i] | (block[4*i + 1] << 8) | (block[4*i + 2] << 16) | (static_cast<uint32_t>(block[4*i + 3]) << 24);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+
+        for (uint32_t i = 0; i < 64; ++i) {
+          uint32_t f, g;
+
+          if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+          } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5*i + 1) % 16;
+          } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3*i + 5) % 16;
+          } else {
+            f = c ^ (b | ~d);
+            g = (7*i) % 16;
+          }
+
+          uint32_t rotated = b + rotate(a + f + K[i] + words[g], SHIFTS[(i / 16) * 4 + i % 4]);
+          a = d;
+          d = c;
+          c = b;
+          b = rotated;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+      }
+  };
+
+  /**
+   * The running sketch, read from a file
+   */
+  class FileSource : public SourceReader {
+    public:
+      FileSource(FILE* file) : file(file) {
+        fseek(file, 0, SEEK_END);
+        length = ftell(file);
+      }
+
+      virtual size_t size() const override {
+        return length;
+      }
+
+      virtual bool read(size_t offset, uint8_t* buffer, size_t size) override {
+        return fseek(file, offset, SEEK_SET) == 0 && fread(buffer, 1, size, file) == size;
+      }
+
+    private:
+      FILE* file;
+      size_t length;
+  };
+
+  /**
+   * The update partition, written to a file.  Like Update, checks the MD5 of what was
+   * written against the one given in begin().
+   */
+  class FileTarget : public TargetWriter {
+    public:
+      FileTarget(FILE* file) : file(file), begun(false) { }
+
+      virtual bool begin(const PatchHeader& header) override {
+        memcpy(expectedMd5, header.targetMd5, sizeof(expectedMd5));
+        begun = true;
+        return true;
+      }
+
+      virtual size_t write(const uint8_t* data, size_t length) override {
+        md5.add(data, length);
+        return fwrite(data, 1, length, file);
+      }
+
+      bool verify() {
+        uint8_t digest[16];
+        md5.finish(digest);
+        return begun && memcmp(digest, expectedMd5, sizeof(digest)) == 0;
+      }
+
+    private:
+      FILE* file;
+      Md5 md5;
+      uint8_t expectedMd5[16];
+      bool begun;
+  };
+
+  /**
+   * Builds patches the way tools/delta_patch.py does
+   */
+  class PatchBuilder {
+    public:
+      PatchBuilder(uint32_t sourceSize, const Bytes& target) {
+        for (char c : { 'R', 'H', 'D', 'P' }) {
+          bytes.push_back(c);
+        }
+        bytes.push_back(PATCH_VERSION);
+        bytes.insert(bytes.end(), 3, 0);
+        uint32(sourceSize);
+        uint32(target.size());
+
+        Md5 md5;
+        uint8_t digest[16];
+        md5.add(target.data(), target.size());
+        md5.finish(digest);
+        bytes.insert(bytes.end(), digest, digest + sizeof(digest));
+      }
+
+      // offset is relative to the end of the previous copy
+      PatchBuilder& copy(int32_t offset, uint32_t length) {
+        bytes.push_back(0x01);
+        varint((static_cast<uint32_t>(offset) << 1) ^ static_cast<uint32_t>(offset >> 31));
+        varint(length);
+        return *this;
+      }
+
+      PatchBuilder& insert(const Bytes& data) {
+        bytes.push_back(0x02);
+        varint(data.size());
+        bytes.insert(bytes.end(), data.begin(), data.end());
+        return *this;
+      }
+
+      PatchBuilder& raw(const Bytes& data) {
+        for (uint8_t b : data) {
+          bytes.push_back(b);
+        }
+        return *this;
+      }
+
+      void varint(uint32_t value) {
+        while (value >= 0x80) {
+          bytes.push_back((value & 0x7F) | 0x80);
+          value >>= 7;
+        }
+        bytes.push_back(value);
+      }
+
+      Bytes bytes;
+
+    private:
+      void uint32(uint32_t value) {
+        for (size_t i = 0; i < 4; ++i) {
+          bytes.push_back(value >> (8 * i));
+        }
+      }
+  };
+
+  struct Result {
+    PatchError error;
+    bool verified;
+    Bytes output;
+  };
+
+  Bytes readAll(FILE* file) {
+    Bytes bytes;
+    uint8_t buffer[512];
+    size_t n;
+
+    fseek(file, 0, SEEK_SET);
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      bytes.insert(bytes.end(), buffer, buffer + n);
+    }
+
+    return bytes;
+  }
+
+  // Applies patch to source in chunks of chunkSize bytes, as an upload would arrive
+  Result apply(const Bytes& source, const Bytes& patch, size_t chunkSize) {
+    FILE* sourceFile = tmpfile();
+    FILE* targetFile = tmpfile();
+    fwrite(source.data(), 1, source.size(), sourceFile);
+
+    FileSource reader(sourceFile);
+    FileTarget writer(targetFile);
+    Patcher patcher(reader, writer);
+
+    for (size_t offset = 0; offset < patch.size() && ! patcher.hasError(); offset += chunkSize) {
+      patcher.write(patch.data() + offset, std::min(chunkSize, patch.size() - offset));
+    }
+
+    Result result;
+    result.verified = patcher.finish() && writer.verify();
+    result.error = patcher.getError();
+    result.output = readAll(targetFile);
+
+    fclose(sourceFile);
+    fclose(targetFile);
+    return result;
+  }
+
+  Bytes pattern(size_t length, uint8_t seed) {
+    Bytes bytes(length);
+
+    for (size_t i = 0; i < length; ++i) {
+      bytes[i] = static_cast<uint8_t>(seed + i * 31 + (i >> 5));
+    }
+
+    return bytes;
+  }
+
+  Bytes concat(const Bytes& a, const Bytes& b) {
+    Bytes bytes(a);
+    bytes.insert(bytes.end(), b.begin(), b.end());
+    return bytes;
+  }
+
+  Bytes slice(const Bytes& bytes, size_t start, size_t length) {
+    return Bytes(bytes.begin() + start, bytes.begin() + start + length);
+  }
+
+  size_t failures = 0;
+
+  // Applies patch in several chunk sizes, and checks that each gives the expected error and,
+  // if there is none, target
+  void check(const char* name, const Bytes& source, const Bytes& patch, PatchError expected, const Bytes* target) {
+    static const size_t CHUNK_SIZES[] = { 1, 7, RICH_HTTP_DELTA_BUFFER_SIZE + 1, 1 << 20 };
+    bool passed = true;
+
+    for (size_t chunkSize : CHUNK_SIZES) {
+      Result result = apply(source, patch, chunkSize);
+
+      if (result.error != expected
+        || (target != nullptr && (! result.verified || result.output != *target))
+        || (target == nullptr && expected == PatchError::NONE && result.verified))
+      {
+        printf("%-44s FAIL (%zu byte chunks: %s)\n", name, chunkSize, errorToString(result.error));
+        passed = false;
+        break;
+      }
+    }
+
+    if (passed) {
+      printf("%-44s ok\n", name);
+    } else {
+      ++failures;
+    }
+  }
+
+  void runCases() {
+    Bytes source = pattern(2000, 1);
+    Bytes inserted = pattern(300, 99);
+
+    {
+      Bytes target = inserted;
+      check("insert only", source, PatchBuilder(source.size(), target).insert(target).bytes, PatchError::NONE, &target);
+    }
+
+    {
+      // Copies forward, then backward relative to the end of the previous copy
+      Bytes target = concat(concat(slice(source, 100, 500), inserted), slice(source, 40, 1000));
+      PatchBuilder patch(source.size(), target);
+      patch.copy(100, 500).insert(inserted).copy(40 - 600, 1000);
+      check("copy and insert, negative offset", source, patch.bytes, PatchError::NONE, &target);
+    }
+
+    {
+      // Longer than the copy buffer, with a three byte length
+      Bytes target = slice(source, 0, 2000);
+      check("copy longer than buffer", source, PatchBuilder(source.size(), target).copy(0, 2000).bytes, PatchError::NONE, &target);
+    }
+
+    {
+      Bytes target = concat(slice(source, 0, 100), inserted);
+      PatchBuilder patch(source.size(), target);
+      patch.copy(0, 100);
+      check("truncated", source, patch.bytes, PatchError::TRUNCATED, nullptr);
+    }
+
+    {
+      Bytes target = slice(source, 0, 100);
+      check("copy out of range", source, PatchBuilder(source.size(), target).copy(1950, 100).bytes, PatchError::COPY_OUT_OF_RANGE, nullptr);
+    }
+
+    {
+      Bytes target = slice(source, 0, 10);
+      check("target overflow", source, PatchBuilder(source.size(), target).copy(0, 11).bytes, PatchError::TARGET_OVERFLOW, nullptr);
+    }
+
+    {
+      Bytes target = inserted;
+      Bytes patch = PatchBuilder(source.size(), target).insert(target).bytes;
+      patch[0] = 'X';
+      check("bad magic", source, patch, PatchError::BAD_MAGIC, nullptr);
+
+      patch[0] = 'R';
+      patch[4] = PATCH_VERSION + 1;
+      check("bad version", source, patch, PatchError::BAD_VERSION, nullptr);
+    }
+
+    {
+      Bytes target = inserted;
+      check("source smaller than patch expects", source, PatchBuilder(source.size() + 1, target).insert(target).bytes, PatchError::SOURCE_MISMATCH, nullptr);
+    }
+
+    {
+      Bytes target = inserted;
+      check("unknown operation", source, PatchBuilder(source.size(), target).raw({ 0x03 }).bytes, PatchError::BAD_OPERATION, nullptr);
+    }
+
+    {
+      // 0xFFFFFFFF needs the low 4 bits of a fifth byte; anything more would be dropped
+      Bytes target = inserted;
+      check("varint wider than 32 bits", source, PatchBuilder(source.size(), target).raw({ 0x02, 0xFF, 0xFF, 0xFF, 0xFF, 0x1F }).bytes, PatchError::BAD_OPERATION, nullptr);
+      check("varint with six bytes", source, PatchBuilder(source.size(), target).raw({ 0x02, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 }).bytes, PatchError::BAD_OPERATION, nullptr);
+      check("five byte varint within 32 bits", source, PatchBuilder(source.size(), target).raw({ 0x02, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F }).bytes, PatchError::TARGET_OVERFLOW, nullptr);
+    }
+
+    {
+      // The patch applies, but the result isn't the image the header describes
+      Bytes target = inserted;
+      Bytes other = pattern(300, 7);
+      check("MD5 mismatch", source, PatchBuilder(source.size(), target).insert(other).bytes, PatchError::NONE, nullptr);
+    }
+  }
+
+  int applyFiles(const char* sourcePath, const char* patchPath, const char* outputPath) {
+    FILE* sourceFile = fopen(sourcePath, "rb");
+    FILE* patchFile = fopen(patchPath, "rb");
+    FILE* outputFile = fopen(outputPath, "wb");
+
+    if (sourceFile == nullptr || patchFile == nullptr || outputFile == nullptr) {
+      fprintf(stderr, "Could not open input or output files\n");
+      return 1;
+    }
+
+    FileSource reader(sourceFile);
+    FileTarget writer(outputFile);
+    Patcher patcher(reader, writer);
+    uint8_t buffer[1460];
+    size_t n;
+
+    // Fed in TCP sized chunks, like an upload
+    while ((n = fread(buffer, 1, sizeof(buffer), patchFile)) > 0 && patcher.write(buffer, n)) { }
+
+    bool applied = patcher.finish();
+    bool verified = applied && writer.verify();
+
+    fclose(sourceFile);
+    fclose(patchFile);
+    fclose(outputFile);
+
+    if (! applied) {
+      fprintf(stderr, "%s\n", errorToString(patcher.getError()));
+      return 1;
+    }
+    if (! verified) {
+      fprintf(stderr, "%s\n", errorToString(PatchError::VERIFY_FAILED));
+      return 1;
+    }
+
+    printf("Wrote %zu bytes\n", patcher.getWritten());
+    return 0;
+  }
+};
+
+int main(int argc, char** argv) {
+  if (argc == 4) {
+    return applyFiles(argv[1], argv[2], argv[3]);
+  }
+
+  if (argc != 1) {
+    fprintf(stderr, "usage: %s [<source.bin> <patch.bin> <output.bin>]\n", argv[0]);
+    return 1;
+  }
+
+  runCases();
+  printf("\n%zu failed\n", failures);
+  return failures > 0 ? 1 : 0;
+}
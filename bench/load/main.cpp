@@ -0,0 +1,620 @@
+// Host-side load generator.  Replays the request mix of the example REST servers against
+// the builtin (ESP8266WebServer) backend with the server mocked out, and reports
+// throughput, latency percentiles and heap usage.
+//
+// Run with:
+//
+//   pio run -e native_load
+//   .pio/build/native_load/program --clients 16 --keep-alive 100
+//
+// Clients are simulated on a virtual clock.  Each client sends a request, waits for the
+// response, thinks for --think-us and sends the next one.  Like the builtin server, the
+// server works on one connection at a time: it keeps serving a persistent connection while
+// its client's next request arrives within the idle timeout, and otherwise accepts the
+// client which has waited longest.  Handling a request advances the clock by the time the
+// library actually took; opening a connection advances it by --connect-us.  A request's
+// latency is the time from when it was sent until its response was complete, so it
+// includes waiting for the server.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <RichHttpServer.h>
+
+#include "../Benchmark.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+using RichHttpConfig = RichHttp::Generics::Configs::EspressifBuiltin;
+using RequestContext = RichHttpConfig::RequestContextType;
+
+namespace {
+  enum Op { GET, LIST, PUT, POST, DELETE, ABOUT, NUM_OPS };
+
+  const char* const OP_NAMES[NUM_OPS] = { "get", "list", "put", "post", "delete", "about" };
+
+  struct Options {
+    size_t clients = 8;
+    size_t requests = 50000;
+    size_t warmup = 1000;
+    // Requests per connection; 0 closes the connection after every response
+    uint16_t keepAlive = RICH_HTTP_KEEP_ALIVE_MAX_REQUESTS;
+    double thinkUs = 0;
+    double connectUs = 100;
+    size_t minBodySize = 16;
+    size_t maxBodySize = 128;
+    size_t things = 32;
+    unsigned seed = 1;
+    bool json = false;
+    unsigned mix[NUM_OPS] = { 50, 15, 15, 10, 5, 5 };
+  };
+
+  struct Client {
+    uint16_t port;
+    bool connected;
+    // Virtual time the client's next request is sent at
+    double sendAt;
+  };
+
+  struct Stats {
+    std::vector<double> latencies[NUM_OPS];
+    std::map<int, size_t> codes;
+    size_t connections = 0;
+    size_t bytesSent = 0;
+  };
+
+  // Things of the example servers.  POST overwrites the oldest thing instead of adding one,
+  // so the store stays the same size for the whole run.
+  std::vector<String> things;
+  size_t nextThing = 0;
+
+  size_t thingId(RequestContext& request) {
+    return request.pathValues.getUint(0);
+  }
+
+  void handleGetThing(RequestContext& request) {
+    size_t id = thingId(request);
+
+    if (id < things.size()) {
+      JsonObject thing = request.response.json.createNestedObject("thing");
+      thing["id"] = id;
+      thing["val"] = things[id];
+    } else {
+      request.response.setCode(404);
+      request.response.json["error"] = "Not found";
+    }
+  }
+
+  void handlePutThing(RequestContext& request) {
+    size_t id = thingId(request);
+
+    if (id < things.size()) {
+      things[id] = request.getJsonBody()["thing"]["val"].as<const char*>();
+      request.response.json["success"] = true;
+    } else {
+      request.response.json["success"] = false;
+      request.response.json["error"] = "Not found";
+      request.response.setCode(404);
+    }
+  }
+
+  void handleDeleteThing(RequestContext& request) {
+    size_t id = thingId(request);
+
+    if (id < things.size()) {
+      things[id] = String();
+      request.response.json["success"] = true;
+    } else {
+      request.response.json["success"] = false;
+      request.response.json["error"] = "Not found";
+      request.response.setCode(404);
+    }
+  }
+
+  void handleAddNewThing(RequestContext& request) {
+    size_t id = nextThing++ % things.size();
+    things[id] = request.getJsonBody()["thing"]["val"].as<const char*>();
+
+    JsonObject obj = request.response.json.createNestedObject("thing");
+    obj["id"] = id;
+    obj["val"] = things[id];
+  }
+
+  void handleAbout(RequestContext& request) {
+    request.response.json["free_heap"] = ESP.getFreeHeap();
+    request.response.json["version"] = "load";
+  }
+
+  bool listNextThing(RequestContext&, uint32_t& cursor, JsonVariant item) {
+    if (cursor >= things.size()) {
+      return false;
+    }
+
+    item["id"] = cursor;
+    item["val"] = things[cursor];
+    ++cursor;
+    return true;
+  }
+
+  const RichHttp::JsonRule THING_SCHEMA[] = {
+    RichHttp::JsonRule::required("thing.val", RichHttp::JsonType::STRING).maxLength(1024),
+  };
+
+  // Same routes as examples/SimpleRestServer
+  void registerRoutes(RichHttpServer<RichHttpConfig>& server) {
+    server
+      .buildHandler("/things/:thing_id<uint>")
+      .on(HTTP_GET, handleGetThing)
+      .setJsonSchema(THING_SCHEMA)
+      .on(HTTP_PUT, handlePutThing)
+      .on(HTTP_DELETE, handleDeleteThing);
+
+    server
+      .buildHandler("/things")
+      .setJsonSchema(THING_SCHEMA)
+      .on(HTTP_POST, handleAddNewThing)
+      .onCollection(listNextThing);
+
+    server
+      .buildHandler("/about")
+      .setDisableAuthOverride()
+      .on(HTTP_GET, handleAbout);
+  }
+
+  // Parses "get=50,put=20,...".  Ops which aren't listed aren't sent.
+  bool parseMix(const char* list, unsigned (&mix)[NUM_OPS]) {
+    unsigned parsed[NUM_OPS] = { };
+    unsigned total = 0;
+
+    while (*list != 0) {
+      const char* equals = strchr(list, '=');
+      const char* end = strchr(list, ',');
+      end = end != nullptr ? end : list + strlen(list);
+
+      if (equals == nullptr || equals > end) {
+        return false;
+      }
+
+      size_t op = 0;
+      while (op < NUM_OPS && (strlen(OP_NAMES[op]) != static_cast<size_t>(equals - list) || strncmp(OP_NAMES[op], list, equals - list) != 0)) {
+        ++op;
+      }
+
+      if (op == NUM_OPS) {
+        return false;
+      }
+
+      parsed[op] = strtoul(equals + 1, nullptr, 10);
+      total += parsed[op];
+      list = *end == ',' ? end + 1 : end;
+    }
+
+    if (total == 0) {
+      return false;
+    }
+
+    memcpy(mix, parsed, sizeof(parsed));
+    return true;
+  }
+
+  void usage(const char* program) {
+    fprintf(stderr,
+      "usage: %s [options]\n"
+      "  --clients N        concurrent clients (8)\n"
+      "  --requests N       measured requests (50000)\n"
+      "  --warmup N         requests sent before measuring (1000)\n"
+      "  --keep-alive N     requests per connection, 0 to close after each (%d)\n"
+      "  --think-us N       time a client waits between requests (0)\n"
+      "  --connect-us N     cost of opening a connection (100)\n"
+      "  --body-size N[-M]  length of thing values sent with PUT and POST (16-128)\n"
+      "  --things N         number of things stored (32)\n"
+      "  --mix LIST         request mix, e.g. get=50,list=15,put=15,post=10,delete=5,about=5\n"
+      "  --seed N           random seed (1)\n"
+      "  --json             print results as a single JSON object\n",
+      program,
+      RICH_HTTP_KEEP_ALIVE_MAX_REQUESTS
+    );
+  }
+
+  bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+      const char* name = argv[i];
+      const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+      if (strcmp(name, "--json") == 0) {
+        options.json = true;
+        continue;
+      }
+
+      if (value == nullptr) {
+        return false;
+      }
+      ++i;
+
+      if (strcmp(name, "--clients") == 0) {
+        options.clients = strtoul(value, nullptr, 10);
+      } else if (strcmp(name, "--requests") == 0) {
+        options.requests = strtoul(value, nullptr, 10);
+      } else if (strcmp(name, "--warmup") == 0) {
+        options.warmup = strtoul(value, nullptr, 10);
+      } else if (strcmp(name, "--keep-alive") == 0) {
+        options.keepAlive = strtoul(value, nullptr, 10);
+      } else if (strcmp(name, "--think-us") == 0) {
+        options.thinkUs = strtod(value, nullptr);
+      } else if (strcmp(name, "--connect-us") == 0) {
+        options.connectUs = strtod(value, nullptr);
+      } else if (strcmp(name, "--body-size") == 0) {
+        char* end;
+        options.minBodySize = options.maxBodySize = strtoul(value, &end, 10);
+
+        if (*end == '-') {
+          options.maxBodySize = strtoul(end + 1, nullptr, 10);
+        }
+      } else if (strcmp(name, "--things") == 0) {
+        options.things = strtoul(value, nullptr, 10);
+      } else if (strcmp(name, "--mix") == 0) {
+        if (! parseMix(value, options.mix)) {
+          return false;
+        }
+      } else if (strcmp(name, "--seed") == 0) {
+        options.seed = strtoul(value, nullptr, 10);
+      } else {
+        return false;
+      }
+    }
+
+    return options.clients > 0 && options.requests > 0 && options.things > 0
+      && options.minBodySize <= options.maxBodySize;
+  }
+
+  class LoadGenerator {
+    public:
+      LoadGenerator(RichHttpServer<RichHttpConfig>& server, const Options& options)
+        : server(server)
+        , options(options)
+        , rng(options.seed)
+        , clients(options.clients)
+        , current(nullptr)
+        , now(0)
+        , nextPort(1024)
+      {
+        for (unsigned weight : options.mix) {
+          totalWeight += weight;
+        }
+
+        for (Client& client : clients) {
+          client.port = 0;
+          client.connected = false;
+          client.sendAt = 0;
+        }
+      }
+
+      // Serves count requests, recording them in stats if it isn't null
+      void run(size_t count, Stats* stats) {
+        for (size_t i = 0; i < count; ++i) {
+          Client& client = next();
+          serve(client, stats);
+        }
+      }
+
+      inline double getNow() const { return now; }
+
+    private:
+      using Clock = std::chrono::steady_clock;
+
+      RichHttpServer<RichHttpConfig>& server;
+      const Options& options;
+      std::mt19937 rng;
+      std::vector<Client> clients;
+      // Client whose connection the server is keeping open
+      Client* current;
+      double now;
+      uint16_t nextPort;
+      unsigned totalWeight = 0;
+
+      Client& next() {
+        double idleTimeout = options.keepAlive > 0 ? RICH_HTTP_KEEP_ALIVE_TIMEOUT * 1000.0 : 0;
+
+        // The server waits on a persistent connection until it times out
+        if (current != nullptr) {
+          if (current->sendAt <= now + idleTimeout) {
+            return *current;
+          }
+
+          now += idleTimeout;
+          closeConnection(*current);
+        }
+
+        Client* longest = &clients[0];
+        for (Client& client : clients) {
+          if (client.sendAt < longest->sendAt) {
+            longest = &client;
+          }
+        }
+
+        return *longest;
+      }
+
+      void closeConnection(Client& client) {
+        client.connected = false;
+
+        if (current == &client) {
+          current = nullptr;
+        }
+      }
+
+      Op pickOp() {
+        unsigned choice = std::uniform_int_distribution<unsigned>(0, totalWeight - 1)(rng);
+
+        for (size_t op = 0; op < NUM_OPS; ++op) {
+          if (choice < options.mix[op]) {
+            return static_cast<Op>(op);
+          }
+          choice -= options.mix[op];
+        }
+
+        return GET;
+      }
+
+      String thingPath() {
+        // Some requests miss, like they would in the field
+        size_t id = std::uniform_int_distribution<size_t>(0, options.things + options.things / 8)(rng);
+        return String("/things/") + String(static_cast<unsigned long>(id));
+      }
+
+      String thingBody() {
+        size_t length = std::uniform_int_distribution<size_t>(options.minBodySize, options.maxBodySize)(rng);
+        String body;
+
+        body.reserve(length + 24);
+        body += "{\"thing\":{\"val\":\"";
+        for (size_t i = 0; i < length; ++i) {
+          body += static_cast<char>('a' + i % 26);
+        }
+        body += "\"}}";
+
+        return body;
+      }
+
+      void serve(Client& client, Stats* stats) {
+        now = std::max(now, client.sendAt);
+
+        if (! client.connected) {
+          now += options.connectUs;
+          client.connected = true;
+          client.port = nextPort++;
+          if (nextPort == 0) {
+            nextPort = 1024;
+          }
+
+          if (stats != nullptr) {
+            ++stats->connections;
+          }
+        }
+
+        server.client().port = client.port;
+        server.client().stopped = false;
+
+        Op op = pickOp();
+        String path;
+        String body;
+        HTTPMethod method = HTTP_GET;
+
+        switch (op) {
+          case GET:
+            path = thingPath();
+            break;
+          case LIST:
+            path = "/things?limit=5";
+            break;
+          case PUT:
+            method = HTTP_PUT;
+            path = thingPath();
+            body = thingBody();
+            break;
+          case POST:
+            method = HTTP_POST;
+            path = "/things";
+            body = thingBody();
+            break;
+          case DELETE:
+            method = HTTP_DELETE;
+            path = thingPath();
+            break;
+          default:
+            path = "/about";
+            break;
+        }
+
+        // Only the library's allocations are counted, not the generator's
+        Bench::allocations.enabled = stats != nullptr;
+        Clock::time_point start = Clock::now();
+        server.pipeline(method, path, body);
+        server.handleClient();
+        now += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+        Bench::allocations.enabled = false;
+
+        if (stats != nullptr) {
+          stats->latencies[op].push_back(now - client.sendAt);
+          ++stats->codes[server.responseCode];
+          stats->bytesSent += server.bytesSent;
+        }
+
+        if (options.keepAlive > 0 && server.keepAliveEnabled && ! server.client().stopped) {
+          current = &client;
+        } else {
+          closeConnection(client);
+        }
+
+        client.sendAt = now + options.thinkUs;
+      }
+  };
+
+  double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+      return 0;
+    }
+
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+  }
+
+  void report(const Options& options, Stats& stats, double elapsedUs, size_t serverBytes, size_t peakBytes, size_t allocations) {
+    std::vector<double> all;
+
+    for (std::vector<double>& latencies : stats.latencies) {
+      std::sort(latencies.begin(), latencies.end());
+      all.insert(all.end(), latencies.begin(), latencies.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    double throughput = all.size() / (elapsedUs / 1e6);
+    double allocationsPerRequest = static_cast<double>(allocations) / all.size();
+
+    if (options.json) {
+      printf(
+        "{\"clients\":%zu,\"requests\":%zu,\"keep_alive\":%u,\"connections\":%zu,"
+        "\"throughput\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f,"
+        "\"bytes_sent\":%zu,\"allocs_per_request\":%.2f,\"server_bytes\":%zu,\"peak_bytes\":%zu,\"ops\":{",
+        options.clients,
+        all.size(),
+        options.keepAlive,
+        stats.connections,
+        throughput,
+        percentile(all, 0.5),
+        percentile(all, 0.99),
+        percentile(all, 0.999),
+        all.empty() ? 0 : all.back(),
+        stats.bytesSent,
+        allocationsPerRequest,
+        serverBytes,
+        peakBytes
+      );
+
+      bool first = true;
+      for (size_t op = 0; op < NUM_OPS; ++op) {
+        const std::vector<double>& latencies = stats.latencies[op];
+
+        if (! latencies.empty()) {
+          printf(
+            "%s\"%s\":{\"count\":%zu,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f}",
+            first ? "" : ",",
+            OP_NAMES[op],
+            latencies.size(),
+            percentile(latencies, 0.5),
+            percentile(latencies, 0.99),
+            percentile(latencies, 0.999)
+          );
+          first = false;
+        }
+      }
+
+      printf("},\"codes\":{");
+      first = true;
+      for (const std::pair<const int, size_t>& code : stats.codes) {
+        printf("%s\"%d\":%zu", first ? "" : ",", code.first, code.second);
+        first = false;
+      }
+      printf("}}\n");
+      return;
+    }
+
+    printf(
+      "%zu clients, keep-alive %u requests/connection, think %.0f us, connect %.0f us, bodies %zu-%zu bytes\n\n",
+      options.clients,
+      options.keepAlive,
+      options.thinkUs,
+      options.connectUs,
+      options.minBodySize,
+      options.maxBodySize
+    );
+
+    printf("%-10s %10s %12s %12s %12s\n", "op", "requests", "p50 us", "p99 us", "p999 us");
+    for (size_t op = 0; op < NUM_OPS; ++op) {
+      const std::vector<double>& latencies = stats.latencies[op];
+
+      if (! latencies.empty()) {
+        printf(
+          "%-10s %10zu %12.1f %12.1f %12.1f\n",
+          OP_NAMES[op],
+          latencies.size(),
+          percentile(latencies, 0.5),
+          percentile(latencies, 0.99),
+          percentile(latencies, 0.999)
+        );
+      }
+    }
+    printf(
+      "%-10s %10zu %12.1f %12.1f %12.1f\n\n",
+      "all",
+      all.size(),
+      percentile(all, 0.5),
+      percentile(all, 0.99),
+      percentile(all, 0.999)
+    );
+
+    printf("throughput    %.1f requests/s (%zu connections, max latency %.1f us)\n", throughput, stats.connections, all.empty() ? 0 : all.back());
+    printf("responses    ");
+    for (const std::pair<const int, size_t>& code : stats.codes) {
+      printf(" %d: %zu", code.first, code.second);
+    }
+    printf(", %zu bytes\n", stats.bytesSent);
+    printf("allocations   %.2f per request\n", allocationsPerRequest);
+
+    if (Bench::tracksLiveBytes) {
+      printf("heap          %zu bytes held by the server, peak %zu bytes above that\n", serverBytes, peakBytes);
+    } else {
+      printf("heap          not tracked on this host\n");
+    }
+  }
+};
+
+int main(int argc, char** argv) {
+  Options options;
+
+  if (! parseOptions(argc, argv, options)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Stats stats;
+  for (std::vector<double>& latencies : stats.latencies) {
+    latencies.reserve(options.requests);
+  }
+
+  size_t baseline = Bench::allocations.liveBytes;
+
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  RichHttp::KeepAlivePolicy keepAlive;
+
+  things.assign(options.things, String("some value"));
+  registerRoutes(server);
+
+  if (options.keepAlive > 0) {
+    keepAlive.setMaxRequests(options.keepAlive);
+    server.setKeepAlive(keepAlive);
+  }
+
+  LoadGenerator generator(server, options);
+  generator.run(options.warmup, nullptr);
+
+  // The server, its routes and the things it stores
+  size_t serverBytes = Bench::allocations.liveBytes - baseline;
+  double startedAt = generator.getNow();
+
+  Bench::allocations.reset();
+  Bench::allocations.resetPeak();
+  generator.run(options.requests, &stats);
+
+  size_t peakBytes = Bench::allocations.peakBytes - std::min(Bench::allocations.peakBytes, baseline + serverBytes);
+  report(options, stats, generator.getNow() - startedAt, serverBytes, peakBytes, Bench::allocations.count);
+  return 0;
+}
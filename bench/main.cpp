@@ -0,0 +1,717 @@
+// Host-side micro-benchmarks for the request pipeline.  Runs against the builtin
+// (ESP8266WebServer) backend with the server mocked out; see bench/mocks.
+//
+// Run with:
+//
+//   pio run -e native_bench -t exec
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <RichHttpServer.h>
+#include <FS.h>
+
+#include "Benchmark.h"
+
+#include <memory>
+
+using RichHttpConfig = RichHttp::Generics::Configs::EspressifBuiltin;
+using RequestContext = RichHttpConfig::RequestContextType;
+using WrapperBuilder = RichHttpConfig::FnWrapperBuilderType;
+
+static const char THING_PATTERN[] = "/things/:thing_id";
+static const char THING_PATH[] = "/things/123";
+static const char THING_BODY[] = "{\"thing\":{\"val\":\"some value\"}}";
+
+static void handleNoop(RequestContext&) { }
+
+static void handleGetThing(RequestContext& request) {
+  JsonObject thing = request.response.json.createNestedObject("thing");
+  thing["id"] = atoi(request.pathVariables.get("thing_id"));
+  thing["val"] = "some value";
+}
+
+static void handlePutThing(RequestContext& request) {
+  JsonObject body = request.getJsonBody().as<JsonObject>();
+  request.response.json["success"] = body.containsKey("thing");
+}
+
+using Route = RichHttp::Route<RichHttpConfig>;
+
+// Same routes as registerRoutes(), declared as a compile-time table
+static constexpr Route ROUTES[] PROGMEM = {
+  Route(HTTP_GET, "/things/:thing_id", handleGetThing),
+  Route(HTTP_PUT, "/things/:thing_id", handlePutThing),
+  Route(HTTP_DELETE, "/things/:thing_id", handleNoop),
+  Route(HTTP_POST, "/things", handleNoop),
+  Route(HTTP_GET, "/things", handleNoop),
+  Route(HTTP_GET, "/about", handleNoop),
+  Route(HTTP_DELETE, "/files/:filename", handleNoop),
+  Route(HTTP_GET, "/files/:filename", handleNoop),
+};
+
+static void registerRoutes(RichHttpServer<RichHttpConfig>& server) {
+  server
+    .buildHandler("/things/:thing_id")
+    .on(HTTP_GET, handleGetThing)
+    .on(HTTP_PUT, handlePutThing)
+    .on(HTTP_DELETE, handleNoop);
+
+  server
+    .buildHandler("/things")
+    .on(HTTP_POST, handleNoop)
+    .on(HTTP_GET, handleNoop);
+
+  server
+    .buildHandler("/about")
+    .on(HTTP_GET, handleNoop);
+
+  server
+    .buildHandler("/files/:filename")
+    .on(HTTP_DELETE, handleNoop)
+    .on(HTTP_GET, handleNoop);
+
+  server.clearBuilders();
+}
+
+// Registers the same routes the way HandlerBuilder::on() did before handlers were
+// compiled: the user's fn behind wrapContextFn, wrapped again for auth, and called through
+// BaseRequestHandler's std::function members.  Kept as a baseline for comparison.
+//
+// The handlers capture the returned wrapper, so it must outlive the server.
+static std::unique_ptr<WrapperBuilder> registerStdFunctionRoutes(RichHttpServer<RichHttpConfig>& server) {
+  std::unique_ptr<WrapperBuilder> wrapper(new WrapperBuilder(&server, server.getAuthProvider()));
+
+  auto add = [&](HTTPMethod verb, const char* path, WrapperBuilder::context_fn_type fn) {
+    WrapperBuilder::body_fn_type wrapped = wrapper->buildAuthedBodyFn(wrapper->wrapContextFn(fn, true, nullptr));
+    server.addHandler(new RichHttpConfig::RequestHandlerType(verb, path, nullptr, wrapped, nullptr));
+  };
+
+  add(HTTP_GET, "/things/:thing_id", handleGetThing);
+  add(HTTP_PUT, "/things/:thing_id", handlePutThing);
+  add(HTTP_DELETE, "/things/:thing_id", handleNoop);
+  add(HTTP_POST, "/things", handleNoop);
+  add(HTTP_GET, "/things", handleNoop);
+  add(HTTP_GET, "/about", handleNoop);
+  add(HTTP_DELETE, "/files/:filename", handleNoop);
+  add(HTTP_GET, "/files/:filename", handleNoop);
+
+  return wrapper;
+}
+
+static void benchmarkRegistration() {
+  Bench::run("register 8 routes (std::function chain)", []() {
+    SimpleAuthProvider auth;
+    std::unique_ptr<WrapperBuilder> wrapper;
+    RichHttpServer<RichHttpConfig> server(80, auth);
+    wrapper = registerStdFunctionRoutes(server);
+  });
+
+  Bench::run("register 8 routes (buildHandler)", []() {
+    SimpleAuthProvider auth;
+    RichHttpServer<RichHttpConfig> server(80, auth);
+    registerRoutes(server);
+  });
+
+  Bench::run("register 8 routes (route table)", []() {
+    SimpleAuthProvider auth;
+    RichHttpServer<RichHttpConfig> server(80, auth);
+    server.addRoutes(ROUTES);
+  });
+
+  // Cost of a second listener serving the same routes
+  RichHttp::SwappableRoutes<RichHttpConfig> shared;
+  shared.swap(ROUTES);
+
+  Bench::run("attach shared 8 route table", [&]() {
+    SimpleAuthProvider auth;
+    RichHttpServer<RichHttpConfig> server(8080, auth);
+    server.attachRoutes(shared);
+  });
+}
+
+static void benchmarkRouteMatching() {
+  RichHttpConfig::RequestHandlerType handler(HTTP_GET, THING_PATTERN, nullptr, nullptr, nullptr);
+  const size_t pathLength = strlen(THING_PATH);
+
+  Bench::run("canHandlePath (match)", [&]() {
+    Bench::doNotOptimize(handler.canHandlePath(THING_PATH, pathLength));
+  });
+
+  Bench::run("canHandlePath (miss)", [&]() {
+    Bench::doNotOptimize(handler.canHandlePath("/files/abc", 10));
+  });
+}
+
+static void benchmarkBindings() {
+  std::shared_ptr<TokenIterator> pattern = std::make_shared<TokenIterator>(THING_PATTERN, strlen(THING_PATTERN), '/');
+
+  Bench::run("UrlTokenBindings construct + get", [&]() {
+    UrlTokenBindings bindings(pattern, THING_PATH);
+    Bench::doNotOptimize(bindings.get("thing_id"));
+  });
+}
+
+static void benchmarkAuth(RichHttpServer<RichHttpConfig>& server) {
+  std::shared_ptr<TokenIterator> pattern = std::make_shared<TokenIterator>(THING_PATTERN, strlen(THING_PATTERN), '/');
+  UrlTokenBindings bindings(pattern, THING_PATH);
+
+  SimpleAuthProvider disabledAuth;
+  WrapperBuilder disabledWrapper(&server, &disabledAuth);
+  WrapperBuilder::fn_type noop = [](const UrlTokenBindings*) { };
+  WrapperBuilder::fn_type disabledFn = disabledWrapper.buildAuthedFn(noop);
+
+  Bench::run("authed fn (auth disabled)", [&]() {
+    disabledFn(&bindings);
+  });
+
+  SimpleAuthProvider enabledAuth;
+  enabledAuth.requireAuthentication("user", "pass");
+  WrapperBuilder enabledWrapper(&server, &enabledAuth);
+  WrapperBuilder::fn_type enabledFn = enabledWrapper.buildAuthedFn(noop);
+
+  Bench::run("authed fn (auth enabled)", [&]() {
+    enabledFn(&bindings);
+  });
+}
+
+static void benchmarkJson(RichHttpServer<RichHttpConfig>& server) {
+  std::shared_ptr<TokenIterator> pattern = std::make_shared<TokenIterator>(THING_PATTERN, strlen(THING_PATTERN), '/');
+  UrlTokenBindings bindings(pattern, THING_PATH);
+  SimpleAuthProvider auth;
+  WrapperBuilder wrapper(&server, &auth);
+
+  RichHttp::PathValues values;
+
+  server.setRequest(HTTP_PUT, THING_PATH, THING_BODY);
+
+  Bench::run("JSON parse (RequestContext::getJsonBody)", [&]() {
+    DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
+    RichHttp::Response response(responseDoc);
+    RequestContext context(server, response, bindings, values, true);
+
+    Bench::doNotOptimize(context.getJsonBody().isNull());
+  });
+
+  DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
+  RichHttp::Response response(responseDoc);
+  JsonArray things = responseDoc.createNestedArray("things");
+  for (int i = 0; i < 10; ++i) {
+    JsonObject thing = things.createNestedObject();
+    thing["id"] = i;
+    thing["val"] = "some value";
+  }
+
+  Bench::run("JSON serialize (sendResponse, 10 objects)", [&]() {
+    wrapper.sendResponse(response);
+  });
+}
+
+static void benchmarkDispatch(RichHttpServer<RichHttpConfig>& server) {
+  WrapperBuilder wrapper(&server, server.getAuthProvider());
+  std::shared_ptr<TokenIterator> pattern = std::make_shared<TokenIterator>(THING_PATTERN, strlen(THING_PATTERN), '/');
+  UrlTokenBindings bindings(pattern, THING_PATH);
+  WrapperBuilder::body_fn_type wrapped = wrapper.wrapContextFn(handleGetThing, true, nullptr);
+
+  server.setRequest(HTTP_GET, THING_PATH);
+
+  Bench::run("wrapContextFn (GET /things/:thing_id)", [&]() {
+    wrapped(&bindings);
+  });
+
+  Bench::run("dispatch GET /things/:thing_id", [&]() {
+    server.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("dispatch PUT /things/:thing_id", [&]() {
+    server.dispatch(HTTP_PUT, THING_PATH, THING_BODY);
+  });
+
+  Bench::run("dispatch GET /about", [&]() {
+    server.dispatch(HTTP_GET, "/about");
+  });
+
+  Bench::run("dispatch 404", [&]() {
+    server.dispatch(HTTP_GET, "/does/not/exist");
+  });
+}
+
+// Same requests as benchmarkDispatch() through the std::function chain, for comparison with
+// the compiled handlers buildHandler() now creates.
+static void benchmarkStdFunctionDispatch() {
+  SimpleAuthProvider auth;
+  std::unique_ptr<WrapperBuilder> wrapper;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  wrapper = registerStdFunctionRoutes(server);
+
+  Bench::run("std::function chain GET /things/:thing_id", [&]() {
+    server.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("std::function chain PUT /things/:thing_id", [&]() {
+    server.dispatch(HTTP_PUT, THING_PATH, THING_BODY);
+  });
+
+  Bench::run("std::function chain GET /about", [&]() {
+    server.dispatch(HTTP_GET, "/about");
+  });
+}
+
+static void benchmarkAdmission() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  registerRoutes(server);
+
+  server.getAdmissionControl()
+    .setMinFreeHeap(16384)
+    .setMinFreeBlock(8192)
+    .addPriorityRoute("/about");
+
+  Bench::run("admission GET /things/:thing_id (admitted)", [&]() {
+    server.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  const uint32_t freeHeap = ESP.freeHeap;
+  ESP.freeHeap = 8192;
+
+  Bench::run("admission GET /things/:thing_id (shed)", [&]() {
+    server.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("admission GET /about (priority)", [&]() {
+    server.dispatch(HTTP_GET, "/about");
+  });
+
+  ESP.freeHeap = freeHeap;
+}
+
+// Adds a response header, as a CORS or timing middleware would
+class HeaderMiddleware : public RichHttp::Middleware {
+  public:
+    virtual void after(RichHttp::Generics::RequestContext& request) override {
+      request.response.addHeader("X-Bench", "1");
+    }
+};
+
+static void benchmarkMiddleware() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  registerRoutes(server);
+
+  RichHttp::Middleware noop;
+  HeaderMiddleware header;
+  server.use(noop);
+  server.use(header);
+
+  Bench::run("2 middleware GET /things/:thing_id", [&]() {
+    server.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("2 middleware GET /about", [&]() {
+    server.dispatch(HTTP_GET, "/about");
+  });
+}
+
+static void benchmarkRateLimiter() {
+  RichHttp::RateLimiter limiter(1000, 1000);
+  uint32_t now = 0;
+  uint32_t client = 0;
+  uint16_t retryAfter;
+
+  Bench::run("RateLimiter::allow (8 clients)", [&]() {
+    Bench::doNotOptimize(limiter.allow(1 + (client++ % 8), now++, retryAfter));
+  });
+
+  Bench::run("RateLimiter::allow (1000 clients, evicting)", [&]() {
+    Bench::doNotOptimize(limiter.allow(1 + (client++ % 1000), now++, retryAfter));
+  });
+}
+
+static void benchmarkRouteTableDispatch() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  server.addRoutes(ROUTES);
+
+  Bench::run("route table GET /things/:thing_id", [&]() {
+    server.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("route table PUT /things/:thing_id", [&]() {
+    server.dispatch(HTTP_PUT, THING_PATH, THING_BODY);
+  });
+
+  Bench::run("route table GET /about", [&]() {
+    server.dispatch(HTTP_GET, "/about");
+  });
+
+  Bench::run("route table 404", [&]() {
+    server.dispatch(HTTP_GET, "/does/not/exist");
+  });
+}
+
+static void benchmarkSwappableRoutes() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  RichHttp::SwappableRoutes<RichHttpConfig>& routes = server.addSwappableRoutes();
+  routes.swap(ROUTES);
+
+  Bench::run("swappable table GET /things/:thing_id", [&]() {
+    server.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("swap + reclaim route table", [&]() {
+    routes.swap(ROUTES);
+  });
+}
+
+static void benchmarkAccessLog() {
+  RichHttp::AccessLog log;
+  RichHttp::AccessLogEntry entry = { 0, 0x0100007F, 128, 500, 0, 200, RichHttp::MethodBits::GET };
+
+  Bench::run("AccessLog::record", [&]() {
+    entry.timestamp++;
+    log.record(entry);
+    Bench::doNotOptimize(log);
+  });
+
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  registerRoutes(server);
+  server.setAccessLog(log);
+
+  Bench::run("access log GET /things/:thing_id", [&]() {
+    server.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("access log GET /about", [&]() {
+    server.dispatch(HTTP_GET, "/about");
+  });
+}
+
+static void handleListThingsArg(RequestContext& request) {
+  request.response.json["offset"] = request.server.arg("offset").toInt();
+  request.response.json["limit"] = request.server.arg("limit").toInt();
+}
+
+static void handleListThingsQueryParams(RequestContext& request) {
+  request.response.json["offset"] = request.queryParams.getInt("offset");
+  request.response.json["limit"] = request.queryParams.getInt("limit");
+}
+
+static void benchmarkQueryParams() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> argServer(80, auth);
+  RichHttpServer<RichHttpConfig> queryServer(80, auth);
+
+  argServer.buildHandler("/things").on(HTTP_GET, handleListThingsArg);
+  queryServer.buildHandler("/things").on(HTTP_GET, handleListThingsQueryParams);
+
+  Bench::run("server.arg() GET /things?offset=&limit=", [&]() {
+    argServer.dispatch(HTTP_GET, "/things?offset=20&limit=10");
+  });
+
+  Bench::run("queryParams GET /things?offset=&limit=", [&]() {
+    queryServer.dispatch(HTTP_GET, "/things?offset=20&limit=10");
+  });
+}
+
+static void handleListThingsFull(RequestContext& request) {
+  JsonArray things = request.response.json.createNestedArray("things");
+
+  for (size_t i = 0; i < 10; ++i) {
+    JsonObject thing = things.createNestedObject();
+    thing["id"] = i;
+    thing["name"] = "some thing";
+    thing["val"] = "some value";
+    thing["updated_at"] = 1700000000 + i;
+  }
+}
+
+static const RichHttp::JsonRule THING_SCHEMA[] = {
+  RichHttp::JsonRule::required("thing.val", RichHttp::JsonType::STRING).maxLength(64),
+  RichHttp::JsonRule::optional("thing.count", RichHttp::JsonType::INTEGER).range(0, 100),
+  RichHttp::JsonRule::optional("thing.tags", RichHttp::JsonType::ARRAY).range(0, 8),
+};
+
+static void benchmarkJsonSchema() {
+  RichHttp::JsonSchema schema(THING_SCHEMA);
+  DynamicJsonDocument body(RICH_HTTP_RESPONSE_BUFFER_SIZE);
+  DynamicJsonDocument json(RICH_HTTP_RESPONSE_BUFFER_SIZE);
+  RichHttp::Response response(json);
+
+  JsonObject thing = body.createNestedObject("thing");
+  thing["val"] = "some value";
+  thing["count"] = 12;
+  thing.createNestedArray("tags").add("a");
+
+  Bench::run("JsonSchema::validate (3 rules, valid)", [&]() {
+    Bench::doNotOptimize(schema.validate(body.as<JsonVariantConst>(), response));
+  });
+
+  // The same checks written out in a handler
+  Bench::run("hand-written body checks", [&]() {
+    JsonObjectConst req = body["thing"];
+    JsonVariantConst count = req["count"];
+    JsonVariantConst tags = req["tags"];
+
+    Bench::doNotOptimize(req["val"].is<const char*>()
+      && strlen(req["val"].as<const char*>()) <= 64
+      && (count.isNull() || (count.is<long>() && count.as<long>() >= 0 && count.as<long>() <= 100))
+      && (tags.isNull() || (tags.is<JsonArrayConst>() && tags.size() <= 8)));
+  });
+}
+
+static void benchmarkFieldSelection() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+
+  server.buildHandler("/things").on(HTTP_GET, handleListThingsFull);
+
+  Bench::run("GET /things (10 objects)", [&]() {
+    server.dispatch(HTTP_GET, "/things");
+  });
+
+  Bench::run("GET /things?fields=things.id", [&]() {
+    server.dispatch(HTTP_GET, "/things?fields=things.id");
+  });
+}
+
+static void benchmarkSingleFlight() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  RichHttp::SingleFlight singleFlight;
+
+  server.buildHandler("/things").on(HTTP_GET, handleListThingsFull);
+  server.buildHandler("/shared/things").setSingleFlight(singleFlight).on(HTTP_GET, handleListThingsFull);
+
+  Bench::run("4 polls GET /things (10 objects)", [&]() {
+    for (size_t i = 0; i < 4; ++i) {
+      server.dispatch(HTTP_GET, "/things");
+    }
+  });
+
+  // The builtin server sends each response before the next request, so nothing is shared and
+  // this measures the overhead
+  Bench::run("4 polls GET /things, single-flight", [&]() {
+    for (size_t i = 0; i < 4; ++i) {
+      server.dispatch(HTTP_GET, "/shared/things");
+    }
+  });
+}
+
+static void handleConditionalGet(RequestContext& request) {
+  request.response.json["etag"] = request.getHeader("If-None-Match");
+}
+
+static void benchmarkCollectedHeaders() {
+  static const char* ALL_HEADERS[] = { "Host", "User-Agent", "Accept", "Accept-Encoding", "Connection", "If-None-Match" };
+  const std::vector<std::pair<String, String>> incoming = {
+    { "Host", "192.168.1.10" },
+    { "User-Agent", "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)" },
+    { "Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8" },
+    { "Accept-Encoding", "gzip, deflate" },
+    { "Connection", "keep-alive" },
+    { "If-None-Match", "\"5f3a\"" },
+  };
+
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> allServer(80, auth);
+  RichHttpServer<RichHttpConfig> declaredServer(80, auth);
+
+  allServer.buildHandler("/things").on(HTTP_GET, handleConditionalGet);
+  allServer.collectHeaders(ALL_HEADERS, 6);
+  allServer.setIncomingHeaders(incoming);
+
+  declaredServer.buildHandler("/things").collectHeader("If-None-Match").on(HTTP_GET, handleConditionalGet);
+  declaredServer.setIncomingHeaders(incoming);
+
+  Bench::run("GET /things, 6 headers kept", [&]() {
+    allServer.dispatch(HTTP_GET, "/things");
+  });
+
+  Bench::run("GET /things, 1 declared header kept", [&]() {
+    declaredServer.dispatch(HTTP_GET, "/things");
+  });
+}
+
+static void benchmarkKeepAlive() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  RichHttp::KeepAlivePolicy policy;
+
+  registerRoutes(server);
+  server.setKeepAlive(policy);
+
+  Bench::run("keep-alive GET /things/:thing_id", [&]() {
+    server.pipeline(HTTP_GET, THING_PATH);
+    server.handleClient();
+  });
+
+  Bench::run("keep-alive 4 pipelined GETs (handleClient)", [&]() {
+    for (size_t i = 0; i < RICH_HTTP_KEEP_ALIVE_PIPELINE_DEPTH; ++i) {
+      server.pipeline(HTTP_GET, THING_PATH);
+    }
+    server.handleClient();
+  });
+}
+
+static void handleGetTypedThing(RequestContext& request) {
+  JsonObject thing = request.response.json.createNestedObject("thing");
+  thing["id"] = request.pathValues.getUint(0);
+  thing["val"] = "some value";
+}
+
+static constexpr Route TYPED_ROUTES[] PROGMEM = {
+  Route(HTTP_GET, "/things/:thing_id<uint>", handleGetTypedThing),
+};
+
+static void benchmarkPathValues() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> stringServer(80, auth);
+  RichHttpServer<RichHttpConfig> typedServer(80, auth);
+  RichHttpServer<RichHttpConfig> typedTableServer(80, auth);
+
+  stringServer.buildHandler("/things/:thing_id").on(HTTP_GET, handleGetThing);
+  typedServer.buildHandler("/things/:thing_id<uint>").on(HTTP_GET, handleGetTypedThing);
+  typedTableServer.addRoutes(TYPED_ROUTES);
+
+  Bench::run("pathVariables GET /things/:thing_id", [&]() {
+    stringServer.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("pathValues GET /things/:thing_id<uint>", [&]() {
+    typedServer.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("route table GET /things/:thing_id<uint>", [&]() {
+    typedTableServer.dispatch(HTTP_GET, THING_PATH);
+  });
+
+  Bench::run("route table 404 /things/abc (<uint>)", [&]() {
+    typedTableServer.dispatch(HTTP_GET, "/things/abc");
+  });
+}
+
+static const char STATIC_BODY[] PROGMEM = "<html><body><h1>rich_http_server</h1><p>Some static page</p></body></html>";
+static uint8_t binaryBody[256];
+
+static void handleRawBody(RequestContext& request) {
+  request.response.sendRaw(200, "text/html", STATIC_BODY);
+}
+
+static void handleBufferBody(RequestContext& request) {
+  request.response.sendBuffer(200, "application/octet-stream", binaryBody, sizeof(binaryBody));
+}
+
+static void handleProgmemBody(RequestContext& request) {
+  request.response.sendBuffer_P(200, "text/html", STATIC_BODY, sizeof(STATIC_BODY) - 1);
+}
+
+static void benchmarkRawBodies() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+
+  server.buildHandler("/raw").on(HTTP_GET, handleRawBody);
+  server.buildHandler("/buffer").on(HTTP_GET, handleBufferBody);
+  server.buildHandler("/progmem").on(HTTP_GET, handleProgmemBody);
+
+  Bench::run("sendRaw GET /raw (copied)", [&]() {
+    server.dispatch(HTTP_GET, "/raw");
+  });
+
+  Bench::run("sendBuffer GET /buffer (256 bytes)", [&]() {
+    server.dispatch(HTTP_GET, "/buffer");
+  });
+
+  Bench::run("sendBuffer_P GET /progmem", [&]() {
+    server.dispatch(HTTP_GET, "/progmem");
+  });
+}
+
+static fs::FS uploadFs;
+static fs::File uploadFile;
+static uint8_t uploadBody[32 * 1024];
+
+// Writes each chunk as it arrives, the way an upload handler would without a sink
+static void handleUploadChunk(RequestContext& request) {
+  HTTPUpload& upload = request.server.upload();
+
+  if (upload.status == UPLOAD_FILE_START) {
+    uploadFile = uploadFs.open("/chunked.bin", "w");
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    uploadFile.write(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    uploadFile.close();
+  }
+}
+
+static void benchmarkUploads() {
+  SimpleAuthProvider auth;
+  RichHttpServer<RichHttpConfig> server(80, auth);
+  RichHttp::UploadSink sink(uploadFs, "/sink.bin");
+
+  server.buildHandler("/chunked").on(HTTP_POST, handleNoop, handleUploadChunk);
+  server.buildHandler("/sink").handleUpload(sink);
+
+  Bench::run("upload 32KB, context per chunk", [&]() {
+    server.dispatchUpload("/chunked", uploadBody, sizeof(uploadBody));
+  });
+
+  Bench::run("upload 32KB, UploadSink", [&]() {
+    server.dispatchUpload("/sink", uploadBody, sizeof(uploadBody));
+  });
+}
+
+#if defined(RICH_HTTP_HEAP_STATS)
+static void printHeapStats() {
+  String json;
+  RichHttp::StringPrint out(json);
+  RichHttp::HeapStats::snapshot()->writeTo(out);
+
+  printf("\nPer-route heap stats:\n%s\n", json.c_str());
+}
+#endif
+
+int main() {
+  RichHttp::HeapStats::allocationCounter = &Bench::allocations.lifetimeCount;
+
+  SimpleAuthProvider authProvider;
+  RichHttpServer<RichHttpConfig> server(80, authProvider);
+
+  registerRoutes(server);
+
+  server
+    .buildHandler("/debug/heap")
+    .handleHeapStats();
+  server.clearBuilders();
+
+  Bench::printHeader();
+
+  benchmarkRegistration();
+  benchmarkRouteMatching();
+  benchmarkBindings();
+  benchmarkAuth(server);
+  benchmarkJson(server);
+  benchmarkDispatch(server);
+  benchmarkStdFunctionDispatch();
+  benchmarkAdmission();
+  benchmarkRateLimiter();
+  benchmarkMiddleware();
+  benchmarkRouteTableDispatch();
+  benchmarkSwappableRoutes();
+  benchmarkAccessLog();
+  benchmarkQueryParams();
+  benchmarkPathValues();
+  benchmarkFieldSelection();
+  benchmarkJsonSchema();
+  benchmarkSingleFlight();
+  benchmarkCollectedHeaders();
+  benchmarkKeepAlive();
+  benchmarkRawBodies();
+  benchmarkUploads();
+
+#if defined(RICH_HTTP_HEAP_STATS)
+  printHeapStats();
+#endif
+
+  return 0;
+}
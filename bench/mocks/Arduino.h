@@ -0,0 +1,194 @@
+#pragma once
+
+// Host stand-in for the subset of the Arduino core used by this library.  Only meant
+// for the native benchmark environment.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+#define FPSTR(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t*>(addr))
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define memcpy_P memcpy
+
+inline unsigned long micros() {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+inline unsigned long millis() {
+  return micros() / 1000;
+}
+
+inline void delay(unsigned long) { }
+inline void yield() { }
+
+class String {
+  public:
+    String() { }
+    String(const char* s) : value(s ? s : "") { }
+    String(const char* s, size_t length) : value(s, length) { }
+    String(const __FlashStringHelper* s) : value(reinterpret_cast<const char*>(s)) { }
+    explicit String(char c) : value(1, c) { }
+    explicit String(int v) : value(std::to_string(v)) { }
+    explicit String(unsigned int v) : value(std::to_string(v)) { }
+    explicit String(long v) : value(std::to_string(v)) { }
+    explicit String(unsigned long v) : value(std::to_string(v)) { }
+
+    const char* c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+    bool isEmpty() const { return value.empty(); }
+    bool reserve(unsigned int size) { value.reserve(size); return true; }
+
+    bool concat(const String& s) { value += s.value; return true; }
+    bool concat(const char* s) { if (s) value += s; return s != nullptr; }
+    bool concat(const char* s, unsigned int length) { value.append(s, length); return true; }
+    bool concat(char c) { value += c; return true; }
+
+    String& operator+=(const String& s) { concat(s); return *this; }
+    String& operator+=(const char* s) { concat(s); return *this; }
+    String& operator+=(char c) { concat(c); return *this; }
+
+    bool equals(const String& s) const { return value == s.value; }
+    bool equals(const char* s) const { return value == s; }
+    bool equalsIgnoreCase(const String& s) const { return strcasecmp(c_str(), s.c_str()) == 0; }
+    bool operator==(const String& s) const { return equals(s); }
+    bool operator==(const char* s) const { return equals(s); }
+    bool operator!=(const String& s) const { return !equals(s); }
+    bool operator!=(const char* s) const { return !equals(s); }
+    bool operator<(const String& s) const { return value < s.value; }
+
+    char operator[](unsigned int index) const { return index < value.size() ? value[index] : 0; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+
+    bool startsWith(const String& prefix) const { return value.compare(0, prefix.value.size(), prefix.value) == 0; }
+    int indexOf(char c, unsigned int from = 0) const {
+      size_t ix = value.find(c, from);
+      return ix == std::string::npos ? -1 : static_cast<int>(ix);
+    }
+    String substring(unsigned int from) const { return substring(from, value.size()); }
+    String substring(unsigned int from, unsigned int to) const {
+      from = std::min<unsigned int>(from, value.size());
+      to = std::max(from, std::min<unsigned int>(to, value.size()));
+      return String(value.c_str() + from, to - from);
+    }
+    void toLowerCase() { for (char& c : value) c = tolower(c); }
+    long toInt() const { return atol(c_str()); }
+
+  private:
+    std::string value;
+};
+
+class StringSumHelper : public String {
+  public:
+    StringSumHelper(const String& s) : String(s) { }
+    StringSumHelper(const char* s) : String(s) { }
+};
+
+inline StringSumHelper operator+(const StringSumHelper& lhs, const String& rhs) {
+  StringSumHelper result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+inline StringSumHelper operator+(const StringSumHelper& lhs, const char* rhs) {
+  StringSumHelper result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+class Print {
+  public:
+    virtual ~Print() = default;
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+      size_t n = 0;
+      while (size--) {
+        n += write(*buffer++);
+      }
+      return n;
+    }
+
+    size_t write(const char* s) { return write(reinterpret_cast<const uint8_t*>(s), strlen(s)); }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(reinterpret_cast<const uint8_t*>(s.c_str()), s.length()); }
+    size_t print(const __FlashStringHelper* s) { return print(reinterpret_cast<const char*>(s)); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(long v) { return print(String(v)); }
+    size_t print(unsigned long v) { return print(String(v)); }
+    size_t print(int v) { return print(String(v)); }
+    size_t print(unsigned int v) { return print(String(v)); }
+
+    size_t println() { return print('\n'); }
+    template <class T>
+    size_t println(const T& v) { return print(v) + println(); }
+};
+
+class HardwareSerial : public Print {
+  public:
+    void begin(unsigned long) { }
+
+    virtual size_t write(uint8_t c) override {
+      return fputc(c, stderr) == EOF ? 0 : 1;
+    }
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress {
+  public:
+    IPAddress(uint32_t address = 0) : address(address) { }
+    operator uint32_t() const { return address; }
+
+    String toString() const {
+      char buffer[16];
+      snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u",
+        address & 0xFF, (address >> 8) & 0xFF, (address >> 16) & 0xFF, address >> 24);
+      return String(buffer);
+    }
+
+  private:
+    uint32_t address;
+};
+
+class EspClass {
+  public:
+    uint32_t getFreeHeap() { return freeHeap; }
+    uint32_t getMaxFreeBlockSize() { return maxFreeBlockSize; }
+    uint32_t getFreeSketchSpace() { return 0x100000; }
+    uint32_t getSketchSize() { return 0; }
+    bool flashRead(uint32_t, uint8_t*, size_t) { return false; }
+    void restart() { }
+
+    // Values reported by the heap getters.  Settable so that callers can simulate
+    // memory pressure.
+    uint32_t freeHeap = 40000;
+    uint32_t maxFreeBlockSize = 20000;
+};
+
+extern EspClass ESP;
@@ -0,0 +1,358 @@
+#pragma once
+
+// Host stand-in for ESP8266WebServer.  Requests are injected with dispatch() rather than
+// read from a socket, and responses are discarded after their size is recorded.
+
+#include <Arduino.h>
+#include <functional>
+#include <utility>
+#include <vector>
+
+enum HTTPMethod {
+  HTTP_ANY,
+  HTTP_GET,
+  HTTP_HEAD,
+  HTTP_POST,
+  HTTP_PUT,
+  HTTP_PATCH,
+  HTTP_DELETE,
+  HTTP_OPTIONS
+};
+
+enum HTTPUploadStatus {
+  UPLOAD_FILE_START,
+  UPLOAD_FILE_WRITE,
+  UPLOAD_FILE_END,
+  UPLOAD_FILE_ABORTED
+};
+
+#ifndef HTTP_UPLOAD_BUFLEN
+#define HTTP_UPLOAD_BUFLEN 2048
+#endif
+
+struct HTTPUpload {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+class WiFiClient : public Print {
+  public:
+    WiFiClient(size_t* bytesWritten = nullptr) : bytesWritten(bytesWritten) { }
+
+    virtual size_t write(uint8_t) override {
+      return write(nullptr, 1);
+    }
+
+    virtual size_t write(const uint8_t*, size_t size) override {
+      if (bytesWritten) {
+        *bytesWritten += size;
+      }
+      return size;
+    }
+
+    bool connected() { return ! stopped; }
+    int available() { return pendingBytes; }
+    void stop() { stopped = true; }
+    IPAddress remoteIP() const { return remoteAddress; }
+    uint16_t remotePort() const { return port; }
+
+    // Address of the simulated client.  Defaults to 127.0.0.1.
+    uint32_t remoteAddress = 0x0100007F;
+    uint16_t port = 50000;
+
+    // Bytes waiting to be read, i.e. requests sent without waiting for a response
+    int pendingBytes = 0;
+    bool stopped = false;
+
+  private:
+    size_t* bytesWritten;
+};
+
+class ESP8266WebServer;
+
+class RequestHandler {
+  public:
+    virtual ~RequestHandler() = default;
+
+    virtual bool canHandle(HTTPMethod, const String&) { return false; }
+    virtual bool canUpload(const String&) { return false; }
+    virtual bool handle(ESP8266WebServer&, HTTPMethod, const String&) { return false; }
+    virtual void upload(ESP8266WebServer&, const String&, HTTPUpload&) { }
+};
+
+class ESP8266WebServer {
+  public:
+    ESP8266WebServer(int port = 80)
+      : port(port)
+      , responseCode(0)
+      , contentLength(0)
+      , bytesSent(0)
+      , keepAliveEnabled(true)
+      , authenticated(true)
+      , _client(&bytesSent)
+    { }
+
+    virtual ~ESP8266WebServer() {
+      for (RequestHandler* handler : handlers) {
+        delete handler;
+      }
+    }
+
+    void begin() { }
+    void close() { }
+
+    // Serves the oldest request queued with pipeline(), if there is one
+    void handleClient() {
+      if (! pending.empty()) {
+        PendingRequest request = pending.front();
+        pending.erase(pending.begin());
+
+        _client.pendingBytes = pending.size();
+        dispatch(request.method, request.uri, request.body);
+      }
+    }
+
+    // Queues a request on the simulated connection, to be served by handleClient()
+    void pipeline(HTTPMethod method, const String& uri, const String& body = String()) {
+      pending.push_back(PendingRequest{ method, uri, body });
+      _client.pendingBytes = pending.size();
+    }
+
+    // Whether the connection is kept open after the response.  Reset for each request.
+    void keepAlive(bool keepAlive) { keepAliveEnabled = keepAlive; }
+
+    void addHandler(RequestHandler* handler) {
+      handlers.push_back(handler);
+    }
+
+    typedef std::function<void(void)> THandlerFunction;
+
+    void onNotFound(THandlerFunction fn) {
+      notFoundHandler = fn;
+    }
+
+    // Simulates a request arriving.  uri may include a query string, which isn't decoded.
+    // Returns false if no handler accepted it.
+    bool dispatch(HTTPMethod method, const String& uri, const String& body = String()) {
+      setRequest(method, uri, body);
+
+      for (RequestHandler* handler : handlers) {
+        if (handler->canHandle(method, _uri) && handler->handle(*this, method, _uri)) {
+          return true;
+        }
+      }
+
+      if (notFoundHandler) {
+        notFoundHandler();
+      } else {
+        send(404, "text/plain", "Not found");
+      }
+      return false;
+    }
+
+    // Simulates a file upload arriving in HTTP_UPLOAD_BUFLEN chunks, followed by the request
+    // it was part of.
+    bool dispatchUpload(const String& uri, const uint8_t* data, size_t length) {
+      setRequest(HTTP_POST, uri);
+
+      for (RequestHandler* handler : handlers) {
+        if (handler->canUpload(_uri)) {
+          _upload.status = UPLOAD_FILE_START;
+          _upload.totalSize = 0;
+          _upload.currentSize = 0;
+          handler->upload(*this, _uri, _upload);
+
+          for (size_t offset = 0; offset < length; offset += HTTP_UPLOAD_BUFLEN) {
+            _upload.status = UPLOAD_FILE_WRITE;
+            _upload.currentSize = std::min(length - offset, static_cast<size_t>(HTTP_UPLOAD_BUFLEN));
+            memcpy(_upload.buf, data + offset, _upload.currentSize);
+            _upload.totalSize += _upload.currentSize;
+            handler->upload(*this, _uri, _upload);
+          }
+
+          _upload.status = UPLOAD_FILE_END;
+          _upload.currentSize = 0;
+          handler->upload(*this, _uri, _upload);
+          break;
+        }
+      }
+
+      return dispatch(HTTP_POST, uri);
+    }
+
+    // Headers sent with every subsequent request.  Only collected headers are stored when
+    // a request is set, like the real server.
+    void setIncomingHeaders(const std::vector<std::pair<String, String>>& headers) {
+      incomingHeaders = headers;
+    }
+
+    void collectHeaders(const char* headerKeys[], const size_t headerKeysCount) {
+      collectedHeaders.clear();
+      collectedHeaders.push_back(String("Authorization"));
+
+      for (size_t i = 0; i < headerKeysCount; ++i) {
+        collectedHeaders.push_back(String(headerKeys[i]));
+      }
+    }
+
+    bool hasHeader(const String& name) const {
+      for (const std::pair<String, String>& header : _headers) {
+        if (strcasecmp(header.first.c_str(), name.c_str()) == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    String header(const String& name) const {
+      for (const std::pair<String, String>& header : _headers) {
+        if (strcasecmp(header.first.c_str(), name.c_str()) == 0) {
+          return header.second;
+        }
+      }
+      return String();
+    }
+
+    // Sets the current request without dispatching it.
+    void setRequest(HTTPMethod method, const String& uri, const String& body = String()) {
+      const char* query = strchr(uri.c_str(), '?');
+
+      _method = method;
+      _uri = query != nullptr ? String(uri.c_str(), query - uri.c_str()) : uri;
+      _body = body;
+      _args.clear();
+
+      while (query != nullptr) {
+        const char* name = query + 1;
+        const char* end = strchr(name, '&');
+        const char* nameEnd = end != nullptr ? end : name + strlen(name);
+        const char* equals = static_cast<const char*>(memchr(name, '=', nameEnd - name));
+
+        if (equals != nullptr) {
+          _args.push_back(std::make_pair(String(name, equals - name), String(equals + 1, nameEnd - equals - 1)));
+        } else if (nameEnd > name) {
+          _args.push_back(std::make_pair(String(name, nameEnd - name), String()));
+        }
+
+        query = end;
+      }
+
+      _headers.clear();
+      for (const std::pair<String, String>& header : incomingHeaders) {
+        for (const String& collected : collectedHeaders) {
+          if (strcasecmp(header.first.c_str(), collected.c_str()) == 0) {
+            _headers.push_back(header);
+            break;
+          }
+        }
+      }
+
+      responseCode = 0;
+      keepAliveEnabled = true;
+      contentLength = 0;
+      bytesSent = 0;
+      headers.clear();
+    }
+
+    const String& uri() const { return _uri; }
+    HTTPMethod method() const { return _method; }
+
+    bool hasArg(const String& name) const {
+      if (name == "plain") {
+        return _body.length() > 0;
+      }
+
+      for (const std::pair<String, String>& arg : _args) {
+        if (arg.first == name) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    String arg(const String& name) const {
+      if (name == "plain") {
+        return _body;
+      }
+
+      for (const std::pair<String, String>& arg : _args) {
+        if (arg.first == name) {
+          return arg.second;
+        }
+      }
+      return String();
+    }
+
+    int args() const { return _args.size(); }
+    const String& argName(int i) const { return _args[i].first; }
+    const String& arg(int i) const { return _args[i].second; }
+
+    bool authenticate(const char*, const char*) { return authenticated; }
+    void requestAuthentication() { send(401, "text/plain", ""); }
+
+    void setContentLength(size_t length) { contentLength = length; }
+    void sendHeader(const String& name, const String& value, bool = false) {
+      headers.push_back(std::make_pair(name, value));
+    }
+
+    void send(int code, const char* contentType, const String& content) {
+      send(code, String(contentType), content);
+    }
+
+    void send(int code, const String&, const String& content) {
+      responseCode = code;
+      bytesSent += content.length();
+    }
+
+    void send_P(int code, PGM_P contentType, PGM_P content) {
+      send(code, contentType, String(content));
+    }
+
+    void send_P(int code, PGM_P, PGM_P, size_t length) {
+      responseCode = code;
+      bytesSent += length;
+    }
+
+    void sendContent(const String& content) { bytesSent += content.length(); }
+    void sendContent_P(PGM_P, size_t length) { bytesSent += length; }
+
+    WiFiClient& client() { return _client; }
+    HTTPUpload& upload() { return _upload; }
+
+    int port;
+
+    // Recorded about the most recent response
+    int responseCode;
+    size_t contentLength;
+    size_t bytesSent;
+    std::vector<std::pair<String, String>> headers;
+    bool keepAliveEnabled;
+
+    // Result of authenticate()
+    bool authenticated;
+
+  protected:
+    struct PendingRequest {
+      HTTPMethod method;
+      String uri;
+      String body;
+    };
+
+    std::vector<RequestHandler*> handlers;
+    THandlerFunction notFoundHandler;
+    HTTPMethod _method;
+    String _uri;
+    String _body;
+    std::vector<std::pair<String, String>> _args;
+    std::vector<std::pair<String, String>> incomingHeaders;
+    std::vector<String> collectedHeaders{ String("Authorization") };
+    std::vector<std::pair<String, String>> _headers;
+    std::vector<PendingRequest> pending;
+    WiFiClient _client;
+    HTTPUpload _upload;
+};
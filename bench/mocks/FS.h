@@ -0,0 +1,61 @@
+#pragma once
+
+// Host stand-in for the Arduino filesystem API.  Files are discarded as they're written;
+// only their sizes and the number of writes are kept.
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+
+namespace fs {
+  struct FileStats {
+    size_t size;
+    size_t writes;
+  };
+
+  class File : public Print {
+    public:
+      File(FileStats* stats = nullptr) : stats(stats) { }
+
+      virtual size_t write(uint8_t c) override {
+        return write(&c, 1);
+      }
+
+      virtual size_t write(const uint8_t*, size_t size) override {
+        if (stats == nullptr) {
+          return 0;
+        }
+
+        stats->size += size;
+        ++stats->writes;
+        return size;
+      }
+
+      void close() { stats = nullptr; }
+      explicit operator bool() const { return stats != nullptr; }
+
+    private:
+      FileStats* stats;
+  };
+
+  class FS {
+    public:
+      File open(const char* path, const char*) {
+        FileStats& stats = files[path];
+        stats = FileStats{ 0, 0 };
+        return File(&stats);
+      }
+
+      bool exists(const char* path) const { return files.count(path) > 0; }
+      bool remove(const char* path) { return files.erase(path) > 0; }
+
+      const FileStats& stats(const char* path) { return files[path]; }
+
+    private:
+      std::map<std::string, FileStats> files;
+  };
+};
+
+using fs::File;
+using fs::FS;
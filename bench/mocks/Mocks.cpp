@@ -0,0 +1,6 @@
+#include <Arduino.h>
+#include <Updater.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+UpdaterClass Update;
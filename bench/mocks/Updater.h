@@ -0,0 +1,50 @@
+#pragma once
+
+// Host stand-in for the ESP8266 Updater.  Accepts and discards the image.
+
+#include <Arduino.h>
+
+class UpdaterClass {
+  public:
+    bool begin(size_t size) {
+      _size = size;
+      _written = 0;
+      _error = false;
+      return true;
+    }
+
+    size_t write(uint8_t*, size_t length) {
+      if (_written + length > _size) {
+        _error = true;
+        return 0;
+      }
+      _written += length;
+      return length;
+    }
+
+    bool end(bool evenIfRemaining = false) {
+      if (!evenIfRemaining && _written != _size) {
+        _error = true;
+      }
+      _size = 0;
+      return !_error;
+    }
+
+    bool setMD5(const char*) { return true; }
+    void runAsync(bool) { }
+
+    bool isRunning() const { return _size > 0; }
+    bool hasError() const { return _error; }
+    size_t size() const { return _size; }
+
+    void printError(Print& out) {
+      out.println(F("Update error"));
+    }
+
+  private:
+    size_t _size = 0;
+    size_t _written = 0;
+    bool _error = false;
+};
+
+extern UpdaterClass Update;
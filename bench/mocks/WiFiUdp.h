@@ -0,0 +1,6 @@
+#pragma once
+
+class WiFiUDP {
+  public:
+    static void stopAll() { }
+};
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host stand-in for the ESP8266 core's version header
+#define ARDUINO_ESP8266_MAJOR 3
+#define ARDUINO_ESP8266_MINOR 1
+#define ARDUINO_ESP8266_REVISION 2
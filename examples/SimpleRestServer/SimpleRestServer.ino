@@ -16,7 +16,7 @@ using namespace std::placeholders;
 // Simple REST server with CRUD routes:
 //
 //   * POST /things - add a new thing
-//   * GET  /things - list all things
+//   * GET  /things - list things, a page at a time
 //   * GET  /things/:id - get specified thing
 //   * PUT  /things/:id - update value for specified thing
 //   * DELETE /things/:id - delete specified thing
@@ -54,7 +54,7 @@ std::map<size_t, String> things;
 size_t nextId = 1;
 
 void handleGetThing(RequestContext& requestContext) {
-  size_t id = atoi(requestContext.pathVariables.get("thing_id"));
+  size_t id = requestContext.pathValues.getUint(0);
 
   if (things.count(id)) {
     JsonObject thing = requestContext.response.json.createNestedObject("thing");
@@ -66,21 +66,20 @@ void handleGetThing(RequestContext& requestContext) {
   }
 }
 
+// Request bodies of PUT /things/:thing_id and POST /things must look like
+// {"thing":{"val":"..."}}.  Bodies which don't are rejected with 400.
+static const RichHttp::JsonRule THING_SCHEMA[] = {
+  RichHttp::JsonRule::required("thing.val", RichHttp::JsonType::STRING).maxLength(64),
+};
+
 void handlePutThing(RequestContext& request) {
-  size_t id = atoi(request.pathVariables.get("thing_id"));
+  size_t id = request.pathValues.getUint(0);
 
   if (things.count(id)) {
-    JsonObject req = request.getJsonBody().as<JsonObject>();
-
-    if (req.containsKey("thing")) {
-      req = req["thing"];
-      things[id] = req["val"].as<const char*>();
-      request.response.json["success"] = true;
-    } else {
-      request.response.json["success"] = false;
-      request.response.json["error"] = "Request object must contain key `thing'.";
-      request.response.setCode(400);
-    }
+    // Checked against THING_SCHEMA before the handler is called
+    JsonObject req = request.getJsonBody()["thing"];
+    things[id] = req["val"].as<const char*>();
+    request.response.json["success"] = true;
   } else {
     request.response.json["success"] = false;
     request.response.json["error"] = "Not found";
@@ -89,7 +88,7 @@ void handlePutThing(RequestContext& request) {
 }
 
 void handleDeleteThing(RequestContext& request) {
-  size_t id = atoi(request.pathVariables.get("thing_id"));
+  size_t id = request.pathValues.getUint(0);
 
   if (things.count(id)) {
     things.erase(id);
@@ -109,28 +108,28 @@ void handleAbout(RequestContext& request) {
 
 void handleAddNewThing(RequestContext& request) {
   JsonObject body = request.getJsonBody().as<JsonObject>();
+  size_t id = nextId++;
+  things[id] = body["thing"]["val"].as<const char*>();
 
-  if (! body["thing"].isNull()) {
-    size_t id = nextId++;
-    things[id] = body["thing"]["val"].as<const char*>();
-
-    JsonObject obj = request.response.json.createNestedObject("thing");
-    obj["id"] = id;
-    obj["val"] = things[id];
-  } else {
-    request.response.setCode(400);
-    request.response.json["error"] = "Must contain key `thing'";
-  }
+  JsonObject obj = request.response.json.createNestedObject("thing");
+  obj["id"] = id;
+  obj["val"] = things[id];
 }
 
-void handleListThings(RequestContext& request) {
-  JsonArray arr = request.response.json.createNestedArray("things");
+// Lists one thing in a page of GET /things.  The cursor is the smallest id which hasn't
+// been listed yet.
+bool listNextThing(RequestContext& request, uint32_t& cursor, JsonVariant item) {
+  std::map<size_t, String>::iterator it = things.lower_bound(cursor);
 
-  for (std::map<size_t, String>::iterator it = things.begin(); it != things.end(); ++it) {
-    JsonObject obj = arr.createNestedObject();
-    obj["id"] = it->first;
-    obj["val"] = it->second;
+  if (it == things.end()) {
+    return false;
   }
+
+  item["id"] = it->first;
+  item["val"] = it->second;
+  cursor = it->first + 1;
+
+  return true;
 }
 
 void handleAuth(RequestContext& request) {
@@ -230,19 +229,22 @@ void setup() {
 
   WiFi.begin(QUOTE(WIFI_SSID), QUOTE(WIFI_PASSWORD));
 
-  // Handle requests of the form GET /things/:thing_id.
-  // For example, the request `GET /things/abc` would bind `abc` to the request
-  // variable `thing_id`.
+  // Handle requests of the form GET /things/:thing_id.  The id must be an unsigned
+  // integer, so e.g. `GET /things/abc` doesn't match and gets a 404.  Handlers read it
+  // with `pathValues.getUint(0)`.
   server
-    .buildHandler("/things/:thing_id")
+    .buildHandler("/things/:thing_id<uint>")
     .on(HTTP_GET, handleGetThing)
+    // Applies to the POST, PUT and PATCH routes added after it
+    .setJsonSchema(THING_SCHEMA)
     .on(HTTP_PUT, handlePutThing)
     .on(HTTP_DELETE, handleDeleteThing);
 
   server
     .buildHandler("/things")
+    .setJsonSchema(THING_SCHEMA)
     .on(HTTP_POST, handleAddNewThing)
-    .on(HTTP_GET, handleListThings);
+    .onCollection(listNextThing);
 
   server
     .buildHandler("/about")
@@ -267,6 +269,11 @@ void setup() {
     .buildHandler("/firmware")
     .handleOTA();
 
+  // Accepts patches generated with tools/delta_patch.py
+  server
+    .buildHandler("/firmware/delta")
+    .handleDeltaOTA();
+
   server.clearBuilders();
   server.begin();
 }
@@ -0,0 +1,169 @@
+#include "AccessLog.h"
+#include "RouteMethods.h"
+
+namespace RichHttp {
+  static void printAddress(Print& out, uint32_t address) {
+    for (size_t i = 0; i < 4; ++i) {
+      if (i > 0) {
+        out.print('.');
+      }
+      out.print(static_cast<unsigned int>((address >> (8 * i)) & 0xFF));
+    }
+  }
+
+  /**
+   * Copy of the log's entries, rendered as JSON or CSV.  The body is rendered in parts (a
+   * header, each entry, and a footer), and read() resumes from the part the last chunk ended
+   * in, so sending it in chunks doesn't render the whole log for each one.
+   */
+  class AccessLogSnapshot : public BodyWriter {
+    public:
+      AccessLogSnapshot(const AccessLog& log, AccessLog::Format format)
+        : entries(new AccessLogEntry[log.size()])
+        , numEntries(log.size())
+        , capacity(log.getCapacity())
+        , total(log.getTotal())
+        , format(format)
+        , cursorPart(0)
+        , cursorOffset(0)
+      {
+        for (size_t i = 0; i < numEntries; ++i) {
+          entries[i] = log.at(i);
+        }
+      }
+
+      virtual void writeTo(Print& out) const override {
+        for (size_t part = 0; part < numParts(); ++part) {
+          writePart(out, part);
+        }
+      }
+
+      virtual size_t read(uint8_t* buffer, size_t size, size_t offset) const override {
+        // Chunks are normally read in order, but start over if one is read again
+        if (offset < cursorOffset) {
+          cursorPart = 0;
+          cursorOffset = 0;
+        }
+
+        size_t base = cursorOffset;
+        WindowPrint window(buffer, size, offset - base);
+
+        // The next chunk starts in or after the last part written to this one
+        for (size_t part = cursorPart; part < numParts() && window.written() < size; ++part) {
+          cursorPart = part;
+          cursorOffset = base + window.getPosition();
+          writePart(window, part);
+        }
+
+        return window.written();
+      }
+
+    private:
+      std::unique_ptr<AccessLogEntry[]> entries;
+      size_t numEntries;
+      size_t capacity;
+      uint32_t total;
+      AccessLog::Format format;
+
+      // Last part written by read(), and the offset it starts at
+      mutable size_t cursorPart;
+      mutable size_t cursorOffset;
+
+      // The header, one part per entry, then the footer
+      inline size_t numParts() const { return numEntries + 2; }
+
+      void writePart(Print& out, size_t part) const {
+        bool csv = format == AccessLog::Format::CSV;
+
+        if (part == 0) {
+          csv ? writeCsvHeader(out) : writeJsonHeader(out);
+        } else if (part <= numEntries) {
+          csv ? writeCsvEntry(out, part - 1) : writeJsonEntry(out, part - 1);
+        } else if (! csv) {
+          out.print(F("]}"));
+        }
+      }
+
+      void writeCsvHeader(Print& out) const {
+        out.print(F("timestamp,client,method,route,status,bytes,latency_us\n"));
+      }
+
+      void writeCsvEntry(Print& out, size_t i) const {
+        const AccessLogEntry& entry = entries[i];
+
+        out.print(entry.timestamp);
+        out.print(',');
+        printAddress(out, entry.client);
+        out.print(',');
+        out.print(RouteMethods::nameOf(entry.method));
+        out.print(',');
+        if (entry.route != AccessLog::NO_ROUTE) {
+          out.print(static_cast<unsigned int>(entry.route));
+        }
+        out.print(',');
+        out.print(static_cast<unsigned int>(entry.status));
+        out.print(',');
+        out.print(entry.bytes);
+        out.print(',');
+        out.print(entry.latency);
+        out.print('\n');
+      }
+
+      void writeJsonHeader(Print& out) const {
+        out.print(F("{\"capacity\":"));
+        out.print(static_cast<unsigned int>(capacity));
+        out.print(F(",\"total\":"));
+        out.print(total);
+        out.print(F(",\"entries\":["));
+      }
+
+      void writeJsonEntry(Print& out, size_t i) const {
+        const AccessLogEntry& entry = entries[i];
+
+        if (i > 0) {
+          out.print(',');
+        }
+
+        out.print(F("{\"timestamp\":"));
+        out.print(entry.timestamp);
+        out.print(F(",\"client\":\""));
+        printAddress(out, entry.client);
+        out.print(F("\",\"method\":\""));
+        out.print(RouteMethods::nameOf(entry.method));
+        out.print(F("\",\"route\":"));
+        if (entry.route == AccessLog::NO_ROUTE) {
+          out.print(F("null"));
+        } else {
+          out.print(static_cast<unsigned int>(entry.route));
+        }
+        out.print(F(",\"status\":"));
+        out.print(static_cast<unsigned int>(entry.status));
+        out.print(F(",\"bytes\":"));
+        out.print(entry.bytes);
+        out.print(F(",\"latency_us\":"));
+        out.print(entry.latency);
+        out.print('}');
+      }
+  };
+
+  AccessLog::AccessLog(size_t capacity)
+    : entries(new AccessLogEntry[capacity])
+    , capacity(capacity)
+    , next(0)
+    , total(0)
+  { }
+
+  void AccessLog::clear() {
+    next = 0;
+    total = 0;
+  }
+
+  const AccessLogEntry& AccessLog::at(size_t index) const {
+    size_t start = total < capacity ? 0 : next;
+    return entries[(start + index) % capacity];
+  }
+
+  std::shared_ptr<BodyWriter> AccessLog::snapshot(Format format) const {
+    return std::make_shared<AccessLogSnapshot>(*this, format);
+  }
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+#include "RichResponse.h"
+
+// Default number of entries kept by an AccessLog.  Each entry is 24 bytes.
+#ifndef RICH_HTTP_ACCESS_LOG_SIZE
+#define RICH_HTTP_ACCESS_LOG_SIZE 64
+#endif
+
+namespace RichHttp {
+  /**
+   * A single request in the access log.  Fixed size so that recording one is a copy into a
+   * preallocated slot.
+   */
+  struct AccessLogEntry {
+    // millis() when the request started being handled
+    uint32_t timestamp;
+    // IPv4 address of the client
+    uint32_t client;
+    // Bytes in the response body
+    uint32_t bytes;
+    // Microseconds from when the handler was called until the response was sent
+    uint32_t latency;
+    // Route the request was served by, see AccessLog::NO_ROUTE
+    uint16_t route;
+    uint16_t status;
+    // One of MethodBits
+    uint8_t method;
+  };
+
+  /**
+   * Ring buffer of recently served requests.  Storage is allocated once when the log is
+   * constructed, and the oldest entries are overwritten when it's full.
+   *
+   * Route ids are assigned in registration order.  A route table's routes are numbered
+   * consecutively in table order, and keep their numbers when the table is swapped.
+   */
+  class AccessLog {
+    public:
+      enum class Format { JSON, CSV };
+
+      // Route id for requests not served by a registered route
+      static const uint16_t NO_ROUTE = 0xFFFF;
+
+      AccessLog(size_t capacity = RICH_HTTP_ACCESS_LOG_SIZE);
+
+      inline void record(const AccessLogEntry& entry) {
+        entries[next] = entry;
+
+        if (++next == capacity) {
+          next = 0;
+        }
+        ++total;
+      }
+
+      void clear();
+
+      // Number of entries currently stored
+      inline size_t size() const { return total < capacity ? total : capacity; }
+      inline size_t getCapacity() const { return capacity; }
+
+      // Number of requests recorded since the log was created or cleared, including those
+      // which have since been overwritten
+      inline uint32_t getTotal() const { return total; }
+
+      // Entries from oldest to newest
+      const AccessLogEntry& at(size_t index) const;
+
+      /**
+       * Copies the current entries into a body which can be sent with Response::sendStream().
+       * Requests recorded while it's being sent aren't included.
+       */
+      std::shared_ptr<BodyWriter> snapshot(Format format) const;
+
+    private:
+      std::unique_ptr<AccessLogEntry[]> entries;
+      size_t capacity;
+      size_t next;
+      uint32_t total;
+  };
+};
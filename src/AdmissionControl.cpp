@@ -0,0 +1,164 @@
+#include "AdmissionControl.h"
+#include "RouteTable.h"
+
+namespace RichHttp {
+  AdmissionControl::AdmissionControl()
+    : maxInFlight(0)
+    , minFreeHeap(0)
+    , minFreeBlock(0)
+    , retryAfter(1)
+    , rateLimiter(nullptr)
+    , inFlightTimeout(RICH_HTTP_ADMISSION_IN_FLIGHT_TIMEOUT)
+    , nextTicket(0)
+  {
+    resetCounters();
+  }
+
+  AdmissionControl& AdmissionControl::setMaxInFlight(uint16_t maxInFlight) {
+    this->maxInFlight = maxInFlight;
+    return *this;
+  }
+
+  AdmissionControl& AdmissionControl::setMinFreeHeap(uint32_t minFreeHeap) {
+    this->minFreeHeap = minFreeHeap;
+    return *this;
+  }
+
+  AdmissionControl& AdmissionControl::setMinFreeBlock(uint32_t minFreeBlock) {
+    this->minFreeBlock = minFreeBlock;
+    return *this;
+  }
+
+  AdmissionControl& AdmissionControl::setInFlightTimeout(uint32_t timeout) {
+    this->inFlightTimeout = timeout;
+    return *this;
+  }
+
+  AdmissionControl& AdmissionControl::setRetryAfter(uint16_t seconds) {
+    this->retryAfter = seconds;
+    return *this;
+  }
+
+  AdmissionControl& AdmissionControl::setRateLimiter(RateLimiter* rateLimiter) {
+    this->rateLimiter = rateLimiter;
+    return *this;
+  }
+
+  AdmissionControl& AdmissionControl::addPriorityRoute(const String& path) {
+    priorityRoutes.push_back(path);
+    return *this;
+  }
+
+  bool AdmissionControl::isEnabled() const {
+    return maxInFlight > 0 || minFreeHeap > 0 || minFreeBlock > 0 || rateLimiter != nullptr;
+  }
+
+  bool AdmissionControl::isPriority(const char* path, size_t length) const {
+    for (const String& pattern : priorityRoutes) {
+      if (Routes::matches(pattern.c_str(), path, length)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  AdmissionResult AdmissionControl::admit(const char* path, size_t length, uint32_t client, uint16_t& retryAfter) {
+    if (rateLimiter != nullptr && ! rateLimiter->allow(client, retryAfter)) {
+      return AdmissionResult::RATE_LIMITED;
+    }
+
+    retryAfter = this->retryAfter;
+
+    if (isPriority(path, length)) {
+      priorityAdmitted++;
+      return AdmissionResult::ADMITTED;
+    }
+
+    expireInFlight();
+
+    if (maxInFlight > 0 && inFlightRequests.size() >= maxInFlight) {
+      shedInFlight++;
+      return AdmissionResult::SHED_IN_FLIGHT;
+    }
+
+    if (minFreeHeap > 0 || minFreeBlock > 0) {
+      HeapSnapshot heap = HeapSnapshot::take();
+
+      if (heap.freeHeap < minFreeHeap) {
+        shedFreeHeap++;
+        return AdmissionResult::SHED_FREE_HEAP;
+      }
+
+      if (heap.maxFreeBlock < minFreeBlock) {
+        shedFreeBlock++;
+        return AdmissionResult::SHED_FREE_BLOCK;
+      }
+    }
+
+    admitted++;
+    return AdmissionResult::ADMITTED;
+  }
+
+  uint32_t AdmissionControl::acquire() {
+    uint32_t ticket = nextTicket++;
+
+    inFlightRequests.push_back(InFlightRequest{ ticket, static_cast<uint32_t>(millis()) });
+    return ticket;
+  }
+
+  void AdmissionControl::release(uint32_t ticket) {
+    for (size_t i = 0; i < inFlightRequests.size(); ++i) {
+      if (inFlightRequests[i].ticket == ticket) {
+        inFlightRequests[i] = inFlightRequests.back();
+        inFlightRequests.pop_back();
+        return;
+      }
+    }
+  }
+
+  void AdmissionControl::expireInFlight() {
+    if (inFlightTimeout == 0) {
+      return;
+    }
+
+    uint32_t now = millis();
+
+    for (size_t i = inFlightRequests.size(); i-- > 0; ) {
+      if (now - inFlightRequests[i].acquiredAt >= inFlightTimeout) {
+        inFlightRequests[i] = inFlightRequests.back();
+        inFlightRequests.pop_back();
+        timedOut++;
+      }
+    }
+  }
+
+  void AdmissionControl::resetCounters() {
+    admitted = 0;
+    priorityAdmitted = 0;
+    shedInFlight = 0;
+    shedFreeHeap = 0;
+    shedFreeBlock = 0;
+    timedOut = 0;
+  }
+
+  void AdmissionControl::toJson(JsonObject json) const {
+    json["enabled"] = isEnabled();
+    json["in_flight"] = inFlightRequests.size();
+    json["max_in_flight"] = maxInFlight;
+    json["min_free_heap"] = minFreeHeap;
+    json["min_free_block"] = minFreeBlock;
+    json["admitted"] = admitted;
+    json["priority_admitted"] = priorityAdmitted;
+    json["in_flight_timed_out"] = timedOut;
+
+    JsonObject shed = json.createNestedObject("shed");
+    shed["in_flight"] = shedInFlight;
+    shed["free_heap"] = shedFreeHeap;
+    shed["free_block"] = shedFreeBlock;
+
+    if (rateLimiter != nullptr) {
+      rateLimiter->toJson(json.createNestedObject("rate_limit"));
+    }
+  }
+};
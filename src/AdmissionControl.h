@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <vector>
+
+#include "HeapStats.h"
+#include "RateLimiter.h"
+
+// Async backend: number of rejected requests whose reason is remembered until their 503 or
+// 429 is sent.  If more are pending, the oldest are answered with 503.
+#ifndef RICH_HTTP_ADMISSION_PENDING_REJECTIONS
+#define RICH_HTTP_ADMISSION_PENDING_REJECTIONS 4
+#endif
+
+// Default for AdmissionControl::setInFlightTimeout(), in milliseconds
+#ifndef RICH_HTTP_ADMISSION_IN_FLIGHT_TIMEOUT
+#define RICH_HTTP_ADMISSION_IN_FLIGHT_TIMEOUT 30000
+#endif
+
+namespace RichHttp {
+  enum class AdmissionResult {
+    ADMITTED,
+    RATE_LIMITED,
+    SHED_IN_FLIGHT,
+    SHED_FREE_HEAP,
+    SHED_FREE_BLOCK
+  };
+
+  /**
+   * Decides whether a new request should be served or rejected with 503 based on free heap,
+   * the largest free block, and the number of requests in flight, or with 429 if the client
+   * has exceeded the server-wide rate limit.  Each platform registers a handler in front of
+   * all routes which consults this before any route runs.
+   *
+   * All checks are disabled by default.  A threshold of 0 disables the corresponding check.
+   */
+  class AdmissionControl {
+    public:
+      AdmissionControl();
+
+      // Only enforced on the async backend.  The builtin server handles one request at a time.
+      AdmissionControl& setMaxInFlight(uint16_t maxInFlight);
+      AdmissionControl& setMinFreeHeap(uint32_t minFreeHeap);
+      AdmissionControl& setMinFreeBlock(uint32_t minFreeBlock);
+
+      // Requests stop counting as in flight after this many milliseconds even if release()
+      // was never called, e.g. because a handler replaced the callback which would have
+      // called it.  0 disables the timeout.
+      AdmissionControl& setInFlightTimeout(uint32_t timeout);
+
+      // Seconds sent in the Retry-After header of shed requests
+      AdmissionControl& setRetryAfter(uint16_t seconds);
+
+      // Limits every client across all routes.  Applies to priority routes too.  Pass null
+      // to remove.
+      AdmissionControl& setRateLimiter(RateLimiter* rateLimiter);
+
+      // Requests matching a priority route (e.g., health checks, OTA) are always admitted.
+      // Path variables are supported in the same form as in buildHandler().
+      AdmissionControl& addPriorityRoute(const String& path);
+
+      bool isEnabled() const;
+      inline uint16_t getRetryAfter() const { return retryAfter; }
+      inline uint16_t getInFlight() const { return inFlightRequests.size(); }
+
+      // retryAfter is set to the number of seconds the client should wait if the request is
+      // rejected.
+      AdmissionResult admit(const char* path, size_t length, uint32_t client, uint16_t& retryAfter);
+
+      // Track a request which was admitted until release() is called with the returned
+      // ticket, or it times out.  Releasing a ticket which timed out does nothing.
+      uint32_t acquire();
+      void release(uint32_t ticket);
+
+      void resetCounters();
+      void toJson(JsonObject json) const;
+
+    private:
+      uint16_t maxInFlight;
+      uint32_t minFreeHeap;
+      uint32_t minFreeBlock;
+      uint16_t retryAfter;
+      std::vector<String> priorityRoutes;
+      RateLimiter* rateLimiter;
+      uint32_t inFlightTimeout;
+
+      struct InFlightRequest {
+        uint32_t ticket;
+        uint32_t acquiredAt;
+      };
+
+      std::vector<InFlightRequest> inFlightRequests;
+      uint32_t nextTicket;
+
+      uint32_t admitted;
+      uint32_t priorityAdmitted;
+      uint32_t shedInFlight;
+      uint32_t shedFreeHeap;
+      uint32_t shedFreeBlock;
+      uint32_t timedOut;
+
+      bool isPriority(const char* path, size_t length) const;
+      void expireInFlight();
+  };
+};
@@ -0,0 +1,23 @@
+#include "CorsPolicy.h"
+
+namespace RichHttp {
+  CorsPolicy::CorsPolicy()
+    : allowHeaders(F("Content-Type, Authorization"))
+    , maxAge(600)
+  { }
+
+  CorsPolicy& CorsPolicy::setAllowOrigin(const String& origin) {
+    this->allowOrigin = origin;
+    return *this;
+  }
+
+  CorsPolicy& CorsPolicy::setAllowHeaders(const String& headers) {
+    this->allowHeaders = headers;
+    return *this;
+  }
+
+  CorsPolicy& CorsPolicy::setMaxAge(uint32_t seconds) {
+    this->maxAge = seconds;
+    return *this;
+  }
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <stdint.h>
+
+namespace RichHttp {
+  /**
+   * Cross-origin headers sent with every route's response and with automatically answered
+   * OPTIONS preflight requests.  Disabled until an origin is set.
+   */
+  class CorsPolicy {
+    public:
+      CorsPolicy();
+
+      // Value of Access-Control-Allow-Origin, e.g. "*".  An empty origin disables CORS headers.
+      CorsPolicy& setAllowOrigin(const String& origin);
+
+      // Value of Access-Control-Allow-Headers in preflight responses.  Defaults to
+      // "Content-Type, Authorization".
+      CorsPolicy& setAllowHeaders(const String& headers);
+
+      // Seconds browsers may cache a preflight response.  0 omits Access-Control-Max-Age.
+      CorsPolicy& setMaxAge(uint32_t seconds);
+
+      inline bool isEnabled() const { return allowOrigin.length() > 0; }
+      inline const String& getAllowOrigin() const { return allowOrigin; }
+
+      /**
+       * Calls addHeader(name, value) for each header of a preflight response.  allow is the
+       * value of the Allow header for the requested path.
+       */
+      template <class AddHeaderFn>
+      void preflightHeaders(const String& allow, AddHeaderFn addHeader) const {
+        addHeader(F("Allow"), allow);
+
+        if (! isEnabled()) {
+          return;
+        }
+
+        addHeader(F("Access-Control-Allow-Origin"), allowOrigin);
+        addHeader(F("Access-Control-Allow-Methods"), allow);
+        addHeader(F("Access-Control-Allow-Headers"), allowHeaders);
+
+        if (maxAge > 0) {
+          addHeader(F("Access-Control-Max-Age"), String(maxAge));
+        }
+      }
+
+    private:
+      String allowOrigin;
+      String allowHeaders;
+      uint32_t maxAge;
+  };
+};
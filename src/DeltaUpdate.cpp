@@ -0,0 +1,371 @@
+#include "DeltaUpdate.h"
+
+#include <string.h>
+#include <algorithm>
+#include <memory>
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <Update.h>
+#include <esp_ota_ops.h>
+#elif defined(ARDUINO_ARCH_ESP8266)
+#include <Updater.h>
+#endif
+
+namespace RichHttp {
+  namespace Delta {
+    static const uint8_t PATCH_MAGIC[] = { 'R', 'H', 'D', 'P' };
+
+    static const uint8_t OP_COPY = 0x01;
+    static const uint8_t OP_INSERT = 0x02;
+
+    static uint32_t readUint32(const uint8_t* data) {
+      return static_cast<uint32_t>(data[0])
+        | (static_cast<uint32_t>(data[1]) << 8)
+        | (static_cast<uint32_t>(data[2]) << 16)
+        | (static_cast<uint32_t>(data[3]) << 24);
+    }
+
+    const char* errorToString(PatchError error) {
+      switch (error) {
+        case PatchError::NONE:              return "No error";
+        case PatchError::BAD_MAGIC:         return "Not a delta patch";
+        case PatchError::BAD_VERSION:       return "Unsupported patch version";
+        case PatchError::SOURCE_MISMATCH:   return "Patch was generated against a different image";
+        case PatchError::BAD_OPERATION:     return "Invalid patch operation";
+        case PatchError::COPY_OUT_OF_RANGE: return "Copy outside of source image";
+        case PatchError::TARGET_OVERFLOW:   return "Patch exceeds target size";
+        case PatchError::TRUNCATED:         return "Patch ended before target was complete";
+        case PatchError::BEGIN_FAILED:      return "Could not begin update";
+        case PatchError::READ_FAILED:       return "Error reading source image";
+        case PatchError::WRITE_FAILED:      return "Error writing target image";
+        case PatchError::VERIFY_FAILED:     return "Reconstructed image failed verification";
+      }
+      return "Unknown error";
+    }
+
+    void PatchHeader::targetMd5Hex(char* buffer) const {
+      static const char HEX_DIGITS[] = "0123456789abcdef";
+
+      for (size_t i = 0; i < sizeof(targetMd5); ++i) {
+        buffer[2*i] = HEX_DIGITS[targetMd5[i] >> 4];
+        buffer[2*i + 1] = HEX_DIGITS[targetMd5[i] & 0x0F];
+      }
+      buffer[2*sizeof(targetMd5)] = 0;
+    }
+
+    Patcher::Patcher(SourceReader& source, TargetWriter& target)
+      : source(source)
+      , target(target)
+    {
+      reset();
+    }
+
+    void Patcher::reset() {
+      memset(&header, 0, sizeof(header));
+      error = PatchError::NONE;
+      state = State::HEADER;
+      headerLength = 0;
+      varint = 0;
+      varintShift = 0;
+      copyOffset = 0;
+      sourcePosition = 0;
+      remaining = 0;
+      written = 0;
+    }
+
+    bool Patcher::isComplete() const {
+      return !hasError()
+        && state == State::OPCODE
+        && written == header.targetSize;
+    }
+
+    bool Patcher::write(const uint8_t* data, size_t length) {
+      size_t i = 0;
+
+      while (i < length && !hasError()) {
+        if (isComplete()) {
+          return fail(PatchError::TARGET_OVERFLOW);
+        }
+
+        switch (state) {
+          case State::HEADER: {
+            size_t n = std::min(HEADER_SIZE - headerLength, length - i);
+            memcpy(headerBuffer + headerLength, data + i, n);
+            headerLength += n;
+            i += n;
+
+            if (headerLength == HEADER_SIZE) {
+              parseHeader();
+            }
+            break;
+          }
+
+          case State::OPCODE: {
+            uint8_t op = data[i++];
+
+            varint = 0;
+            varintShift = 0;
+
+            if (op == OP_COPY) {
+              state = State::COPY_OFFSET;
+            } else if (op == OP_INSERT) {
+              state = State::INSERT_LENGTH;
+            } else {
+              fail(PatchError::BAD_OPERATION);
+            }
+            break;
+          }
+
+          case State::COPY_OFFSET:
+            if (readVarint(data[i++])) {
+              // zigzag-decode the relative offset
+              copyOffset = static_cast<int32_t>((varint >> 1) ^ -static_cast<int32_t>(varint & 1));
+              varint = 0;
+              varintShift = 0;
+              state = State::COPY_LENGTH;
+            }
+            break;
+
+          case State::COPY_LENGTH:
+            if (readVarint(data[i++])) {
+              int64_t start = static_cast<int64_t>(sourcePosition) + copyOffset;
+
+              if (start < 0 || start + varint > header.sourceSize) {
+                fail(PatchError::COPY_OUT_OF_RANGE);
+              } else if (copyFromSource(static_cast<size_t>(start))) {
+                state = State::OPCODE;
+              }
+            }
+            break;
+
+          case State::INSERT_LENGTH:
+            if (readVarint(data[i++])) {
+              if (varint > header.targetSize - written) {
+                fail(PatchError::TARGET_OVERFLOW);
+              } else {
+                remaining = varint;
+                state = remaining > 0 ? State::INSERT_DATA : State::OPCODE;
+              }
+            }
+            break;
+
+          case State::INSERT_DATA: {
+            size_t n = std::min(remaining, length - i);
+
+            if (emit(data + i, n)) {
+              i += n;
+              remaining -= n;
+
+              if (remaining == 0) {
+                state = State::OPCODE;
+              }
+            }
+            break;
+          }
+        }
+      }
+
+      return !hasError();
+    }
+
+    bool Patcher::finish() {
+      if (!hasError() && !isComplete()) {
+        fail(PatchError::TRUNCATED);
+      }
+      return !hasError();
+    }
+
+    bool Patcher::fail(PatchError error) {
+      this->error = error;
+      return false;
+    }
+
+    bool Patcher::parseHeader() {
+      if (memcmp(headerBuffer, PATCH_MAGIC, sizeof(PATCH_MAGIC)) != 0) {
+        return fail(PatchError::BAD_MAGIC);
+      }
+      if (headerBuffer[4] != PATCH_VERSION) {
+        return fail(PatchError::BAD_VERSION);
+      }
+
+      header.sourceSize = readUint32(headerBuffer + 8);
+      header.targetSize = readUint32(headerBuffer + 12);
+      memcpy(header.targetMd5, headerBuffer + 16, sizeof(header.targetMd5));
+
+      // The running image may carry trailing padding, so only require that everything the
+      // patch references is present.  The target MD5 catches patches for the wrong image.
+      if (header.sourceSize > source.size()) {
+        return fail(PatchError::SOURCE_MISMATCH);
+      }
+      if (! target.begin(header)) {
+        return fail(PatchError::BEGIN_FAILED);
+      }
+
+      state = State::OPCODE;
+      return true;
+    }
+
+    bool Patcher::readVarint(uint8_t b) {
+      // A fifth byte only has room for the top 4 bits of a uint32_t
+      if (varintShift > 28 || (varintShift == 28 && b > 0x0F)) {
+        return fail(PatchError::BAD_OPERATION);
+      }
+
+      varint |= static_cast<uint32_t>(b & 0x7F) << varintShift;
+      varintShift += 7;
+
+      return (b & 0x80) == 0;
+    }
+
+    bool Patcher::copyFromSource(size_t start) {
+      size_t length = varint;
+
+      if (length > header.targetSize - written) {
+        return fail(PatchError::TARGET_OVERFLOW);
+      }
+
+      sourcePosition = start;
+
+      while (length > 0) {
+        size_t n = std::min(length, sizeof(copyBuffer));
+
+        if (! source.read(sourcePosition, copyBuffer, n)) {
+          return fail(PatchError::READ_FAILED);
+        }
+        if (! emit(copyBuffer, n)) {
+          return false;
+        }
+
+        sourcePosition += n;
+        length -= n;
+      }
+
+      return true;
+    }
+
+    bool Patcher::emit(const uint8_t* data, size_t length) {
+      if (length > 0 && target.write(data, length) != length) {
+        return fail(PatchError::WRITE_FAILED);
+      }
+
+      written += length;
+      return true;
+    }
+
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+    namespace {
+      class RunningSketchReader : public SourceReader {
+        public:
+          virtual size_t size() const override {
+            return ESP.getSketchSize();
+          }
+
+          virtual bool read(size_t offset, uint8_t* buffer, size_t length) override {
+#if defined(ARDUINO_ARCH_ESP32)
+            const esp_partition_t* partition = esp_ota_get_running_partition();
+            return partition != nullptr && esp_partition_read(partition, offset, buffer, length) == ESP_OK;
+#else
+            // The running sketch always starts at the beginning of flash on the ESP8266.
+            return ESP.flashRead(offset, buffer, length);
+#endif
+          }
+      };
+
+      class UpdaterWriter : public TargetWriter {
+        public:
+          virtual bool begin(const PatchHeader& header) override {
+            if (! Update.begin(header.targetSize)) {
+              return false;
+            }
+
+            char md5[2*sizeof(header.targetMd5) + 1];
+            header.targetMd5Hex(md5);
+            return Update.setMD5(md5);
+          }
+
+          virtual size_t write(const uint8_t* data, size_t length) override {
+            return Update.write(const_cast<uint8_t*>(data), length);
+          }
+      };
+
+      RunningSketchReader sketchReader;
+      UpdaterWriter updaterWriter;
+      std::unique_ptr<Patcher> patcher;
+      PatchError lastError = PatchError::NONE;
+
+      void abortUpdate() {
+        patcher.reset();
+
+        if (Update.isRunning()) {
+#if defined(ARDUINO_ARCH_ESP32)
+          Update.abort();
+#else
+          Update.end(false);
+#endif
+        }
+      }
+    };
+
+    bool beginUpdate() {
+      // A previous delta update which never ended, e.g. because the client disconnected
+      if (patcher) {
+        abortUpdate();
+      }
+
+      lastError = PatchError::NONE;
+      patcher.reset(new Patcher(sketchReader, updaterWriter));
+      return true;
+    }
+
+    bool writeUpdate(const uint8_t* data, size_t length) {
+      if (! patcher) {
+        return false;
+      }
+      if (! patcher->write(data, length)) {
+        lastError = patcher->getError();
+        return false;
+      }
+      return true;
+    }
+
+    bool endUpdate() {
+      if (! patcher) {
+        return false;
+      }
+
+      bool success = patcher->finish();
+      lastError = patcher->getError();
+      patcher.reset();
+
+      if (success) {
+        success = Update.end();
+
+        if (! success) {
+          lastError = PatchError::VERIFY_FAILED;
+        }
+      } else {
+        abortUpdate();
+      }
+
+      return success;
+    }
+
+    bool hasUpdateError() {
+      return lastError != PatchError::NONE || Update.hasError();
+    }
+
+    void printUpdateError(Print& out) {
+      if (lastError != PatchError::NONE) {
+        out.print(F("Delta update error: "));
+        out.println(errorToString(lastError));
+      } else {
+        Update.printError(out);
+      }
+    }
+
+    PatchError getUpdateError() {
+      return lastError;
+    }
+#endif
+  };
+};
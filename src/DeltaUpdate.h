@@ -0,0 +1,160 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef RICH_HTTP_DELTA_BUFFER_SIZE
+#define RICH_HTTP_DELTA_BUFFER_SIZE 256
+#endif
+
+namespace RichHttp {
+  namespace Delta {
+    /**
+     * Patch layout (all integers little endian):
+     *
+     *   header:
+     *     char[4]  magic ("RHDP")
+     *     uint8_t  version (1)
+     *     uint8_t  reserved[3]
+     *     uint32_t source image size
+     *     uint32_t target image size
+     *     uint8_t  target image MD5 (16 bytes)
+     *
+     *   followed by a sequence of operations until the target size is reached:
+     *     0x01 COPY   <zigzag varint: source offset relative to the end of the previous copy> <varint: length>
+     *     0x02 INSERT <varint: length> <length literal bytes>
+     *
+     * Patches are generated with tools/delta_patch.py.
+     */
+    static const uint8_t PATCH_VERSION = 1;
+    static const size_t HEADER_SIZE = 32;
+
+    enum class PatchError {
+      NONE,
+      BAD_MAGIC,
+      BAD_VERSION,
+      SOURCE_MISMATCH,
+      BAD_OPERATION,
+      COPY_OUT_OF_RANGE,
+      TARGET_OVERFLOW,
+      TRUNCATED,
+      BEGIN_FAILED,
+      READ_FAILED,
+      WRITE_FAILED,
+      VERIFY_FAILED
+    };
+
+    const char* errorToString(PatchError error);
+
+    struct PatchHeader {
+      uint32_t sourceSize;
+      uint32_t targetSize;
+      uint8_t targetMd5[16];
+
+      // Writes the target MD5 as a 32-character hex string (plus terminator) to the buffer.
+      void targetMd5Hex(char* buffer) const;
+    };
+
+    /**
+     * Random-access reader for the image the patch was generated against (e.g., the
+     * currently running sketch).
+     */
+    class SourceReader {
+      public:
+        virtual ~SourceReader() = default;
+
+        virtual size_t size() const = 0;
+        virtual bool read(size_t offset, uint8_t* buffer, size_t length) = 0;
+    };
+
+    /**
+     * Sequential writer for the reconstructed image (e.g., the update partition).
+     */
+    class TargetWriter {
+      public:
+        virtual ~TargetWriter() = default;
+
+        // Called once the patch header has been parsed, before any image data is written.
+        virtual bool begin(const PatchHeader& header) = 0;
+        virtual size_t write(const uint8_t* data, size_t length) = 0;
+    };
+
+    /**
+     * Streaming patch decoder.  Patch data can be fed in chunks of any size.  Literal
+     * bytes are forwarded straight from the input chunk; copied bytes pass through a
+     * single fixed buffer, so RAM use is bounded by RICH_HTTP_DELTA_BUFFER_SIZE
+     * regardless of image or patch size.
+     */
+    class Patcher {
+      public:
+        Patcher(SourceReader& source, TargetWriter& target);
+
+        void reset();
+
+        // Feeds the next chunk of the patch.  Returns false if an error occurred.
+        bool write(const uint8_t* data, size_t length);
+
+        // Call after the last chunk.  Returns false if the patch ended early or failed.
+        bool finish();
+
+        // True once the full target image has been written.
+        bool isComplete() const;
+        bool hasError() const { return error != PatchError::NONE; }
+        PatchError getError() const { return error; }
+
+        const PatchHeader& getHeader() const { return header; }
+        size_t getWritten() const { return written; }
+
+      private:
+        enum class State {
+          HEADER,
+          OPCODE,
+          COPY_OFFSET,
+          COPY_LENGTH,
+          INSERT_LENGTH,
+          INSERT_DATA
+        };
+
+        SourceReader& source;
+        TargetWriter& target;
+
+        PatchHeader header;
+        PatchError error;
+        State state;
+
+        uint8_t headerBuffer[HEADER_SIZE];
+        size_t headerLength;
+
+        uint32_t varint;
+        uint8_t varintShift;
+
+        int32_t copyOffset;
+        size_t sourcePosition;
+        size_t remaining;
+        size_t written;
+
+        uint8_t copyBuffer[RICH_HTTP_DELTA_BUFFER_SIZE];
+
+        bool fail(PatchError error);
+        bool parseHeader();
+        // Consumes one varint byte.  Returns true when the varint is complete.
+        bool readVarint(uint8_t b);
+        // Copies the pending varint length from the given source offset to the target.
+        bool copyFromSource(size_t start);
+        bool emit(const uint8_t* data, size_t length);
+    };
+
+#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
+    // Mirrors the Update API, applying a patch against the running sketch and writing the
+    // result through Update.  Only one delta update can be in progress at a time; beginning
+    // one aborts any which never ended.  endUpdate() aborts the update if the patch failed.
+    bool beginUpdate();
+    bool writeUpdate(const uint8_t* data, size_t length);
+    bool endUpdate();
+    bool hasUpdateError();
+    PatchError getUpdateError();
+    void printUpdateError(Print& out);
+#endif
+  };
+};
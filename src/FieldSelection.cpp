@@ -0,0 +1,183 @@
+#include "FieldSelection.h"
+
+#include <string.h>
+
+static_assert(RICH_HTTP_MAX_SELECTED_FIELDS <= 32, "Selected fields are tracked in a 32-bit mask");
+
+namespace RichHttp {
+  // Writes s as a quoted JSON string
+  static void writeString(Print& out, const char* s, size_t length) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    out.write('"');
+
+    // Runs of characters which don't need escaping are written together
+    size_t start = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+      char c = s[i];
+      char escaped = 0;
+
+      switch (c) {
+        case '"': escaped = '"'; break;
+        case '\\': escaped = '\\'; break;
+        case '\b': escaped = 'b'; break;
+        case '\f': escaped = 'f'; break;
+        case '\n': escaped = 'n'; break;
+        case '\r': escaped = 'r'; break;
+        case '\t': escaped = 't'; break;
+        default:
+          if (static_cast<uint8_t>(c) >= 0x20) {
+            continue;
+          }
+          break;
+      }
+
+      out.write(reinterpret_cast<const uint8_t*>(s + start), i - start);
+      start = i + 1;
+
+      if (escaped != 0) {
+        const char sequence[] = { '\\', escaped };
+        out.write(reinterpret_cast<const uint8_t*>(sequence), sizeof(sequence));
+      } else {
+        const char sequence[] = { '\\', 'u', '0', '0', HEX_DIGITS[(c >> 4) & 0xF], HEX_DIGITS[c & 0xF] };
+        out.write(reinterpret_cast<const uint8_t*>(sequence), sizeof(sequence));
+      }
+    }
+
+    out.write(reinterpret_cast<const uint8_t*>(s + start), length - start);
+    out.write('"');
+  }
+
+  FieldSelection::FieldSelection(JsonVariantConst root)
+    : root(root)
+    , numFields(0)
+  { }
+
+  bool FieldSelection::select(const char* list) {
+    numFields = 0;
+
+    if (list == nullptr) {
+      return false;
+    }
+
+    for (const char* start = list; *start != 0; ) {
+      const char* end = strchr(start, ',');
+      if (end == nullptr) {
+        end = start + strlen(start);
+      }
+
+      // Ignore whitespace around each field, e.g. "id, name"
+      const char* from = start;
+      const char* to = end;
+
+      while (from < to && *from == ' ') {
+        ++from;
+      }
+      while (to > from && *(to - 1) == ' ') {
+        --to;
+      }
+
+      if (from < to) {
+        if (numFields == RICH_HTTP_MAX_SELECTED_FIELDS) {
+          numFields = 0;
+          return false;
+        }
+
+        fields[numFields++] = Field{ from, static_cast<size_t>(to - from) };
+      }
+
+      start = *end == ',' ? end + 1 : end;
+    }
+
+    return numFields > 0;
+  }
+
+  void FieldSelection::writeTo(Print& out) const {
+    if (numFields == 0) {
+      serializeJson(root, out);
+    } else {
+      uint32_t all = numFields == 32 ? 0xFFFFFFFF : (1UL << numFields) - 1;
+      writeSelected(out, root, all, 0);
+    }
+  }
+
+  void FieldSelection::writeSelected(Print& out, JsonVariantConst value, uint32_t active, size_t offset) const {
+    if (value.is<JsonObjectConst>()) {
+      writeObject(out, value.as<JsonObjectConst>(), active, offset);
+    } else if (value.is<JsonArrayConst>()) {
+      bool first = true;
+
+      out.write('[');
+      for (JsonVariantConst element : value.as<JsonArrayConst>()) {
+        if (! first) {
+          out.write(',');
+        }
+        first = false;
+
+        writeSelected(out, element, active, offset);
+      }
+      out.write(']');
+    } else {
+      serializeJson(value, out);
+    }
+  }
+
+  void FieldSelection::writeObject(Print& out, JsonObjectConst object, uint32_t active, size_t offset) const {
+    bool first = true;
+
+    out.write('{');
+
+    for (JsonPairConst pair : object) {
+      const char* key = pair.key().c_str();
+      size_t keyLength = pair.key().size();
+      bool whole = false;
+      uint32_t nested = 0;
+
+      for (size_t i = 0; i < numFields; ++i) {
+        if ((active & (1UL << i)) == 0) {
+          continue;
+        }
+
+        const Field& field = fields[i];
+        const char* rest = field.path + offset;
+        size_t restLength = field.length - offset;
+
+        if (restLength < keyLength || memcmp(rest, key, keyLength) != 0) {
+          continue;
+        }
+
+        if (restLength == keyLength) {
+          whole = true;
+          break;
+        } else if (rest[keyLength] == '.') {
+          nested |= 1UL << i;
+        }
+      }
+
+      // Fields selected within a value that isn't an object or array don't exist
+      JsonVariantConst value = pair.value();
+      bool hasNested = nested != 0 && (value.is<JsonObjectConst>() || value.is<JsonArrayConst>());
+
+      if (! whole && ! hasNested) {
+        continue;
+      }
+
+      if (! first) {
+        out.write(',');
+      }
+      first = false;
+
+      writeString(out, key, keyLength);
+      out.write(':');
+
+      if (whole) {
+        serializeJson(value, out);
+      } else {
+        writeSelected(out, value, nested, offset + keyLength + 1);
+      }
+    }
+
+    out.write('}');
+  }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "RichResponse.h"
+
+// Query parameter selecting the fields of JSON responses, e.g. "?fields=id,thing.name"
+#ifndef RICH_HTTP_FIELDS_PARAM
+#define RICH_HTTP_FIELDS_PARAM "fields"
+#endif
+
+// Maximum number of fields which can be selected.  Requests selecting more get every field.
+#ifndef RICH_HTTP_MAX_SELECTED_FIELDS
+#define RICH_HTTP_MAX_SELECTED_FIELDS 8
+#endif
+
+namespace RichHttp {
+  /**
+   * Renders only the selected fields of a JSON document, e.g. "id,thing.name" renders
+   *
+   *   {"id":1,"thing":{"name":"a","val":2},"other":3}
+   *
+   * as {"id":1,"thing":{"name":"a"}}.  Arrays are transparent: a field selects from each of
+   * an array's elements, so "things.id" selects the id of every object in "things", and
+   * "id" selects the id of every object in a top-level array.
+   *
+   * Fields are filtered while the document is serialized, so nothing is copied.
+   */
+  class FieldSelection : public BodyWriter {
+    public:
+      explicit FieldSelection(JsonVariantConst root);
+
+      // list is a comma separated list of dot separated paths, and must outlive this
+      // object.  Returns false, leaving every field selected, if list is null, empty, or
+      // has more than RICH_HTTP_MAX_SELECTED_FIELDS paths.
+      bool select(const char* list);
+
+      virtual void writeTo(Print& out) const override;
+
+    private:
+      struct Field {
+        const char* path;
+        size_t length;
+      };
+
+      JsonVariantConst root;
+      Field fields[RICH_HTTP_MAX_SELECTED_FIELDS];
+      size_t numFields;
+
+      // active has a bit set for each field matching the path so far.  offset is the length
+      // of that path, including the trailing '.'.
+      void writeSelected(Print& out, JsonVariantConst value, uint32_t active, size_t offset) const;
+      void writeObject(Print& out, JsonObjectConst object, uint32_t active, size_t offset) const;
+  };
+};
@@ -0,0 +1,32 @@
+#include "HeaderSet.h"
+
+#include <strings.h>
+
+namespace RichHttp {
+  HeaderSet::HeaderSet()
+    : count(0)
+  { }
+
+  bool HeaderSet::add(const char* name) {
+    if (contains(name)) {
+      return true;
+    }
+
+    if (count >= RICH_HTTP_MAX_COLLECTED_HEADERS) {
+      return false;
+    }
+
+    names[count++] = name;
+    return true;
+  }
+
+  bool HeaderSet::contains(const char* name) const {
+    for (size_t i = 0; i < count; ++i) {
+      if (strcasecmp(names[i], name) == 0) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+
+// Maximum number of request headers routes can declare with HandlerBuilder::collectHeader()
+#ifndef RICH_HTTP_MAX_COLLECTED_HEADERS
+#define RICH_HTTP_MAX_COLLECTED_HEADERS 8
+#endif
+
+namespace RichHttp {
+  /**
+   * Names of the request headers a server's routes read.  Servers are configured to keep
+   * only these, so other headers aren't stored for each request.  Authorization is always
+   * kept for authentication.
+   *
+   * Names are stored by pointer, and must outlive the server, e.g. string literals.
+   */
+  class HeaderSet {
+    public:
+      HeaderSet();
+
+      // Returns false if RICH_HTTP_MAX_COLLECTED_HEADERS names have already been added.
+      // Adding a name twice has no effect.
+      bool add(const char* name);
+
+      // Case insensitive, like header names
+      bool contains(const char* name) const;
+
+      inline size_t size() const { return count; }
+      inline const char** getNames() { return names; }
+      inline const char* at(size_t index) const { return names[index]; }
+
+    private:
+      const char* names[RICH_HTTP_MAX_COLLECTED_HEADERS];
+      size_t count;
+  };
+};
@@ -0,0 +1,265 @@
+#include "HeapStats.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace RichHttp {
+  namespace HeapStats {
+    const volatile size_t* allocationCounter = nullptr;
+  };
+
+  HeapSnapshot HeapSnapshot::take() {
+    HeapSnapshot snapshot;
+
+    snapshot.freeHeap = ESP.getFreeHeap();
+#if defined(ARDUINO_ARCH_ESP32)
+    snapshot.maxFreeBlock = ESP.getMaxAllocHeap();
+#else
+    snapshot.maxFreeBlock = ESP.getMaxFreeBlockSize();
+#endif
+    snapshot.allocations = HeapStats::allocationCounter != nullptr ? *HeapStats::allocationCounter : 0;
+
+    return snapshot;
+  }
+
+  void PhaseHeapStats::record(const HeapSnapshot& before, const HeapSnapshot& after) {
+    int32_t heapDelta = static_cast<int32_t>(before.freeHeap) - static_cast<int32_t>(after.freeHeap);
+    int32_t blockDrop = static_cast<int32_t>(before.maxFreeBlock) - static_cast<int32_t>(after.maxFreeBlock);
+    size_t allocations = after.allocations - before.allocations;
+
+    maxHeapDelta = std::max(maxHeapDelta, heapDelta);
+    totalHeapDelta += heapDelta;
+    maxFreeBlockDrop = std::max(maxFreeBlockDrop, blockDrop);
+    maxAllocations = std::max(maxAllocations, allocations);
+    totalAllocations += allocations;
+  }
+
+  void PhaseHeapStats::toJson(JsonObject json, uint32_t requests) const {
+    json["max_heap_used"] = maxHeapDelta;
+    json["avg_heap_used"] = requests > 0 ? static_cast<int32_t>(totalHeapDelta / requests) : 0;
+    json["max_free_block_drop"] = maxFreeBlockDrop;
+    json["max_allocations"] = maxAllocations;
+    json["avg_allocations"] = requests > 0 ? static_cast<float>(totalAllocations) / requests : 0;
+  }
+
+  void RouteHeapStats::toJson(JsonObject json) const {
+    json["path"] = path.c_str();
+    json["method"] = method;
+    json["requests"] = requests;
+
+    handler.toJson(json.createNestedObject("handler"), requests);
+    serialize.toJson(json.createNestedObject("serialize"), requests);
+
+    if (uploadChunks > 0) {
+      upload.toJson(json.createNestedObject("upload"), uploadChunks);
+      json["upload_chunks"] = uploadChunks;
+    }
+
+    json["max_retained"] = maxRetained;
+    json["avg_retained"] = requests > 0 ? static_cast<int32_t>(totalRetained / requests) : 0;
+    json["min_free_heap"] = minFreeHeap;
+    json["min_max_free_block"] = minMaxFreeBlock;
+  }
+
+#if defined(RICH_HTTP_HEAP_STATS)
+  namespace HeapStats {
+    static RouteHeapStats routes[RICH_HTTP_HEAP_STATS_MAX_ROUTES];
+    static size_t numRoutes = 0;
+    // Routes registered after RICH_HTTP_HEAP_STATS_MAX_ROUTES was reached
+    static size_t untrackedRoutes = 0;
+
+    static void resetRoute(RouteHeapStats& route) {
+      route.requests = 0;
+      route.handler = PhaseHeapStats();
+      route.serialize = PhaseHeapStats();
+      route.upload = PhaseHeapStats();
+      route.uploadChunks = 0;
+      route.maxRetained = 0;
+      route.totalRetained = 0;
+      route.minFreeHeap = UINT32_MAX;
+      route.minMaxFreeBlock = UINT32_MAX;
+    }
+
+    RouteHeapStats* registerRoute(const String& path, const char* method) {
+      // Route tables swapped in at runtime register their routes again
+      for (size_t i = 0; i < numRoutes; ++i) {
+        if (routes[i].path == path && strcmp(routes[i].method, method) == 0) {
+          return &routes[i];
+        }
+      }
+
+      if (numRoutes >= RICH_HTTP_HEAP_STATS_MAX_ROUTES) {
+        ++untrackedRoutes;
+        return nullptr;
+      }
+
+      RouteHeapStats& route = routes[numRoutes++];
+      route.path = path;
+      route.method = method;
+      resetRoute(route);
+
+      return &route;
+    }
+
+    void reset() {
+      for (size_t i = 0; i < numRoutes; ++i) {
+        resetRoute(routes[i]);
+      }
+    }
+
+    void toJson(JsonObject json) {
+      HeapSnapshot now = HeapSnapshot::take();
+
+      json["enabled"] = true;
+      json["free_heap"] = now.freeHeap;
+      json["max_free_block"] = now.maxFreeBlock;
+      json["untracked_routes"] = untrackedRoutes;
+
+      JsonArray routesJson = json.createNestedArray("routes");
+      for (size_t i = 0; i < numRoutes; ++i) {
+        routes[i].toJson(routesJson.createNestedObject());
+      }
+    }
+
+    // Room for RouteHeapStats::toJson(): its own members and three phases
+    static const size_t ROUTE_JSON_SIZE = JSON_OBJECT_SIZE(12) + 3 * JSON_OBJECT_SIZE(5);
+
+    /**
+     * Copy of the registered routes' stats, rendered as JSON
+     */
+    class HeapStatsSnapshot : public BodyWriter {
+      public:
+        HeapStatsSnapshot()
+          : now(HeapSnapshot::take())
+          , copies(new RouteHeapStats[numRoutes])
+          , numCopies(numRoutes)
+        {
+          for (size_t i = 0; i < numCopies; ++i) {
+            copies[i] = routes[i];
+          }
+        }
+
+        virtual void writeTo(Print& out) const override {
+          out.print(F("{\"enabled\":true,\"free_heap\":"));
+          out.print(now.freeHeap);
+          out.print(F(",\"max_free_block\":"));
+          out.print(now.maxFreeBlock);
+          out.print(F(",\"untracked_routes\":"));
+          out.print(static_cast<unsigned int>(untrackedRoutes));
+          out.print(F(",\"routes\":["));
+
+          for (size_t i = 0; i < numCopies; ++i) {
+            StaticJsonDocument<ROUTE_JSON_SIZE> json;
+            copies[i].toJson(json.to<JsonObject>());
+
+            if (i > 0) {
+              out.print(',');
+            }
+            serializeJson(json, out);
+          }
+
+          out.print(F("]}"));
+        }
+
+      private:
+        HeapSnapshot now;
+        std::unique_ptr<RouteHeapStats[]> copies;
+        size_t numCopies;
+    };
+
+    std::shared_ptr<BodyWriter> snapshot() {
+      return std::make_shared<HeapStatsSnapshot>();
+    }
+  };
+
+  HeapProbe::HeapProbe(RouteHeapStats* stats)
+    : stats(stats)
+  {
+    if (stats != nullptr) {
+      start = last = HeapSnapshot::take();
+    }
+  }
+
+  HeapProbe::~HeapProbe() {
+    if (stats == nullptr) {
+      return;
+    }
+
+    mark(nullptr);
+
+    int32_t retained = static_cast<int32_t>(start.freeHeap) - static_cast<int32_t>(last.freeHeap);
+
+    stats->requests++;
+    stats->maxRetained = std::max(stats->maxRetained, retained);
+    stats->totalRetained += retained;
+  }
+
+  void HeapProbe::handlerStarted() {
+    mark(nullptr);
+  }
+
+  void HeapProbe::handlerFinished() {
+    mark(stats != nullptr ? &stats->handler : nullptr);
+  }
+
+  void HeapProbe::responseSent() {
+    mark(stats != nullptr ? &stats->serialize : nullptr);
+  }
+
+  UploadHeapProbe::UploadHeapProbe(RouteHeapStats* stats)
+    : stats(stats)
+  {
+    if (stats != nullptr) {
+      start = HeapSnapshot::take();
+    }
+  }
+
+  UploadHeapProbe::~UploadHeapProbe() {
+    if (stats == nullptr) {
+      return;
+    }
+
+    HeapSnapshot now = HeapSnapshot::take();
+
+    stats->upload.record(start, now);
+    stats->uploadChunks++;
+    stats->minFreeHeap = std::min(stats->minFreeHeap, now.freeHeap);
+    stats->minMaxFreeBlock = std::min(stats->minMaxFreeBlock, now.maxFreeBlock);
+  }
+
+  void HeapProbe::mark(PhaseHeapStats* phase) {
+    if (stats == nullptr) {
+      return;
+    }
+
+    HeapSnapshot now = HeapSnapshot::take();
+
+    if (phase != nullptr) {
+      phase->record(last, now);
+    }
+
+    stats->minFreeHeap = std::min(stats->minFreeHeap, now.freeHeap);
+    stats->minMaxFreeBlock = std::min(stats->minMaxFreeBlock, now.maxFreeBlock);
+    last = now;
+  }
+#else
+  namespace HeapStats {
+    void reset() { }
+
+    void toJson(JsonObject json) {
+      json["enabled"] = false;
+    }
+
+    class DisabledHeapStats : public BodyWriter {
+      public:
+        virtual void writeTo(Print& out) const override {
+          out.print(F("{\"enabled\":false}"));
+        }
+    };
+
+    std::shared_ptr<BodyWriter> snapshot() {
+      return std::make_shared<DisabledHeapStats>();
+    }
+  };
+#endif
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <memory>
+
+#include "RichResponse.h"
+
+// Define RICH_HTTP_HEAP_STATS to record heap usage around each route's handler and
+// response serialization.  When undefined, the probes compile to nothing.
+
+#ifndef RICH_HTTP_HEAP_STATS_MAX_ROUTES
+#define RICH_HTTP_HEAP_STATS_MAX_ROUTES 32
+#endif
+
+namespace RichHttp {
+  struct HeapSnapshot {
+    uint32_t freeHeap;
+    uint32_t maxFreeBlock;
+    size_t allocations;
+
+    static HeapSnapshot take();
+  };
+
+  /**
+   * Aggregate heap usage for one phase of a request.  Deltas are positive when memory
+   * was consumed during the phase.
+   */
+  struct PhaseHeapStats {
+    int32_t maxHeapDelta;
+    int64_t totalHeapDelta;
+    int32_t maxFreeBlockDrop;
+    size_t maxAllocations;
+    size_t totalAllocations;
+
+    void record(const HeapSnapshot& before, const HeapSnapshot& after);
+    void toJson(JsonObject json, uint32_t requests) const;
+  };
+
+  struct RouteHeapStats {
+    String path;
+    const char* method;
+    uint32_t requests;
+
+    PhaseHeapStats handler;
+    PhaseHeapStats serialize;
+
+    // Each chunk of an upload, averaged over chunks rather than requests
+    PhaseHeapStats upload;
+    uint32_t uploadChunks;
+
+    // Memory which was not released by the time the request completed
+    int32_t maxRetained;
+    int64_t totalRetained;
+
+    // Low-water marks observed at any point while serving this route
+    uint32_t minFreeHeap;
+    uint32_t minMaxFreeBlock;
+
+    void toJson(JsonObject json) const;
+  };
+
+  namespace HeapStats {
+    // Host builds can count allocations by pointing this at a counter which is
+    // incremented from malloc/operator new hooks (see bench/Allocations.cpp).  There's
+    // no such hook on device, so allocation counts are reported as 0 there.
+    extern const volatile size_t* allocationCounter;
+
+#if defined(RICH_HTTP_HEAP_STATS)
+    // Returns the existing stats if the route was already registered, or nullptr if
+    // RICH_HTTP_HEAP_STATS_MAX_ROUTES has been exhausted.
+    RouteHeapStats* registerRoute(const String& path, const char* method);
+#else
+    inline RouteHeapStats* registerRoute(const String&, const char*) { return nullptr; }
+#endif
+
+    // Clears the aggregates for all registered routes.
+    void reset();
+
+    // Writes current heap state and per-route aggregates to the provided object, which
+    // must have room for every route.
+    void toJson(JsonObject json);
+
+    // Copies current heap state and per-route aggregates into a body which can be sent
+    // with Response::sendStream().  Renders one route at a time, so any number of routes
+    // fits.
+    std::shared_ptr<BodyWriter> snapshot();
+  };
+
+  /**
+   * Scoped measurement of a single request.  Construct before the request is set up,
+   * mark the start and end of each phase, and let it go out of scope after everything
+   * allocated for the request has been released.
+   */
+  class HeapProbe {
+    public:
+#if defined(RICH_HTTP_HEAP_STATS)
+      HeapProbe(RouteHeapStats* stats);
+      ~HeapProbe();
+
+      void handlerStarted();
+      void handlerFinished();
+      void responseSent();
+
+    private:
+      RouteHeapStats* stats;
+      HeapSnapshot start;
+      HeapSnapshot last;
+
+      void mark(PhaseHeapStats* phase);
+#else
+      HeapProbe(RouteHeapStats*) { }
+
+      inline void handlerStarted() { }
+      inline void handlerFinished() { }
+      inline void responseSent() { }
+#endif
+  };
+
+  /**
+   * Scoped measurement of one chunk of an upload.  The request's response is measured
+   * separately by a HeapProbe.
+   */
+  class UploadHeapProbe {
+    public:
+#if defined(RICH_HTTP_HEAP_STATS)
+      UploadHeapProbe(RouteHeapStats* stats);
+      ~UploadHeapProbe();
+
+    private:
+      RouteHeapStats* stats;
+      HeapSnapshot start;
+#else
+      UploadHeapProbe(RouteHeapStats*) { }
+#endif
+  };
+};
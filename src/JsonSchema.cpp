@@ -0,0 +1,187 @@
+#include "JsonSchema.h"
+
+#include <string.h>
+
+namespace RichHttp {
+  JsonSchema::JsonSchema(const JsonRule* rules, size_t numRules)
+    : valid(true)
+  {
+    for (size_t i = 0; i < numRules; ++i) {
+      add(rules[i]);
+    }
+  }
+
+  void JsonSchema::add(const JsonRule& rule) {
+    size_t pathLength = strlen(rule.path);
+
+    if (pathLength > UINT8_MAX) {
+      valid = false;
+      return;
+    }
+
+    // Index of the step for the path so far, or -1 for the top-level object
+    int parent = -1;
+    size_t offset = 0;
+    uint8_t depth = 0;
+
+    while (offset <= pathLength) {
+      const char* dot = static_cast<const char*>(memchr(rule.path + offset, '.', pathLength - offset));
+      size_t end = dot != nullptr ? dot - rule.path : pathLength;
+      bool last = end == pathLength;
+
+      if (end == offset || depth >= RICH_HTTP_JSON_SCHEMA_MAX_DEPTH) {
+        valid = false;
+        return;
+      }
+
+      // A parent's children follow it, so its existing children are the steps between it
+      // and the next step at its depth or above
+      size_t index = parent + 1;
+      int found = -1;
+
+      while (index < steps.size() && (parent < 0 || steps[index].depth > steps[parent].depth)) {
+        const Step& step = steps[index];
+
+        if (step.depth == depth && step.pathLength == end && strncmp(step.path, rule.path, end) == 0) {
+          found = index;
+          break;
+        }
+        ++index;
+      }
+
+      if (found < 0) {
+        Step step = {
+          .path = rule.path,
+          .pathLength = static_cast<uint8_t>(end),
+          .keyOffset = static_cast<uint8_t>(offset),
+          .depth = depth,
+          .declared = false,
+          .type = JsonType::OBJECT,
+          .required = false,
+          .bounded = false,
+          .min = 0,
+          .max = 0
+        };
+
+        steps.insert(steps.begin() + index, step);
+        found = index;
+      }
+
+      Step& step = steps[found];
+
+      if (last) {
+        step.declared = true;
+        step.type = rule.type;
+        step.required = rule.isRequired;
+        step.bounded = rule.bounded;
+        step.min = rule.min;
+        step.max = rule.max;
+      } else if (! step.declared && rule.isRequired) {
+        step.required = true;
+      }
+
+      parent = found;
+      offset = end + 1;
+      ++depth;
+    }
+  }
+
+  bool JsonSchema::validate(JsonVariantConst body, Response& response) const {
+    if (! valid) {
+      reject(response, "", 0, "invalid schema");
+      return false;
+    }
+
+    // Value of the last step seen at each depth, so values[step.depth] is its parent's
+    JsonVariantConst values[RICH_HTTP_JSON_SCHEMA_MAX_DEPTH + 1];
+    values[0] = body;
+
+    for (const Step& step : steps) {
+      JsonVariantConst parent = values[step.depth];
+      JsonVariantConst value;
+
+      // Children of a missing optional key aren't checked
+      if (step.depth > 0 && parent.isNull()) {
+        values[step.depth + 1] = value;
+        continue;
+      }
+
+      const char* key = step.path + step.keyOffset;
+      size_t keyLength = step.pathLength - step.keyOffset;
+
+      for (JsonPairConst pair : parent.as<JsonObjectConst>()) {
+        if (pair.key().size() == keyLength && strncmp(pair.key().c_str(), key, keyLength) == 0) {
+          value = pair.value();
+          break;
+        }
+      }
+
+      const char* reason = value.isNull() ? (step.required ? "required" : nullptr) : check(step, value);
+
+      if (reason != nullptr) {
+        reject(response, step.path, step.pathLength, reason);
+        return false;
+      }
+
+      values[step.depth + 1] = value;
+    }
+
+    return true;
+  }
+
+  const char* JsonSchema::check(const Step& step, JsonVariantConst value) {
+    bool typed;
+    double measure;
+
+    switch (step.type) {
+      case JsonType::OBJECT:
+        typed = value.is<JsonObjectConst>();
+        measure = value.size();
+        break;
+      case JsonType::ARRAY:
+        typed = value.is<JsonArrayConst>();
+        measure = value.size();
+        break;
+      case JsonType::STRING:
+        typed = value.is<const char*>();
+        measure = typed ? strlen(value.as<const char*>()) : 0;
+        break;
+      case JsonType::INTEGER:
+        typed = value.is<long>();
+        measure = value.as<long>();
+        break;
+      case JsonType::NUMBER:
+        typed = value.is<double>();
+        measure = value.as<double>();
+        break;
+      case JsonType::BOOLEAN:
+        typed = value.is<bool>();
+        measure = 0;
+        break;
+      default:
+        return nullptr;
+    }
+
+    if (! typed) {
+      return "type";
+    }
+
+    if (step.bounded && (measure < step.min || measure > step.max)) {
+      return "range";
+    }
+
+    return nullptr;
+  }
+
+  void JsonSchema::reject(Response& response, const char* path, size_t pathLength, const char* reason) {
+    String field;
+    field.concat(path, pathLength);
+
+    response.json.clear();
+    JsonObject err = response.json.createNestedObject("error");
+    err["message"] = "Invalid request body";
+    err["id"] = reason;
+    err["field"] = field;
+    response.setCode(400);
+  }
+};
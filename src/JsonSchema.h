@@ -0,0 +1,136 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "RichResponse.h"
+
+// Deepest nesting a JSON schema can check, counting the top-level keys as 1
+#ifndef RICH_HTTP_JSON_SCHEMA_MAX_DEPTH
+#define RICH_HTTP_JSON_SCHEMA_MAX_DEPTH 6
+#endif
+
+namespace RichHttp {
+  enum class JsonType : uint8_t {
+    ANY,
+    OBJECT,
+    ARRAY,
+    STRING,
+    INTEGER,
+    NUMBER,
+    BOOLEAN
+  };
+
+  /**
+   * One key of a JSON request body, named by its dot separated path from the top-level
+   * object, e.g. "thing.val".  Declared in tables:
+   *
+   *   static const RichHttp::JsonRule THING_SCHEMA[] = {
+   *     RichHttp::JsonRule::required("thing.val", RichHttp::JsonType::STRING).maxLength(32),
+   *     RichHttp::JsonRule::optional("thing.count", RichHttp::JsonType::INTEGER).range(0, 100),
+   *   };
+   *
+   * Bounds are the value of numbers, the length of strings, and the size of arrays and
+   * objects.  JSON null counts as missing.
+   */
+  struct JsonRule {
+    const char* path;
+    JsonType type;
+    bool isRequired;
+    bool bounded;
+    int32_t min;
+    int32_t max;
+
+    static constexpr JsonRule required(const char* path, JsonType type = JsonType::ANY) {
+      return JsonRule{ path, type, true, false, 0, 0 };
+    }
+
+    static constexpr JsonRule optional(const char* path, JsonType type = JsonType::ANY) {
+      return JsonRule{ path, type, false, false, 0, 0 };
+    }
+
+    constexpr JsonRule range(int32_t min, int32_t max) const {
+      return JsonRule{ path, type, isRequired, true, min, max };
+    }
+
+    constexpr JsonRule maxLength(int32_t max) const {
+      return range(0, max);
+    }
+  };
+
+  /**
+   * A table of JsonRules compiled into a flat list of steps, ordered so that each key comes
+   * right after its parent.  Validating a body is then one pass over the steps, with each
+   * key looked up in its parent's value.  Parents which aren't in the table are checked to
+   * be objects, and are required if any of their children are.
+   *
+   * The rules' paths are stored by pointer, and must outlive the schema.
+   */
+  class JsonSchema {
+    public:
+      JsonSchema(const JsonRule* rules, size_t numRules);
+
+      template <size_t N>
+      explicit JsonSchema(const JsonRule (&rules)[N])
+        : JsonSchema(rules, N)
+      { }
+
+      // False if a rule is nested deeper than RICH_HTTP_JSON_SCHEMA_MAX_DEPTH, or has an
+      // empty key.  Invalid schemas reject every body.
+      inline bool isValid() const { return valid; }
+
+      // Returns true if body follows the schema.  Otherwise responds with 400 and an error
+      // naming the first field which doesn't.
+      bool validate(JsonVariantConst body, Response& response) const;
+
+    private:
+      struct Step {
+        // Path of the rule the step was created for.  This step's path is its prefix.
+        const char* path;
+        uint8_t pathLength;
+        uint8_t keyOffset;
+        // 0 for top-level keys
+        uint8_t depth;
+        // False if the step was only created as the parent of another
+        bool declared;
+        JsonType type;
+        bool required;
+        bool bounded;
+        int32_t min;
+        int32_t max;
+      };
+
+      std::vector<Step> steps;
+      bool valid;
+
+      void add(const JsonRule& rule);
+      static const char* check(const Step& step, JsonVariantConst value);
+      static void reject(Response& response, const char* path, size_t pathLength, const char* reason);
+  };
+
+  /**
+   * Handler which runs fn only if the request's JSON body follows schema
+   */
+  template <class Fn>
+  struct ValidatedFn {
+    Fn fn;
+    std::shared_ptr<const JsonSchema> schema;
+
+    template <class TContext>
+    void operator()(TContext& request) {
+      JsonDocument& body = request.getJsonBody();
+
+      // A body which didn't parse has already been answered with 400
+      if (request.isJsonBodyInvalid() || ! schema->validate(body.template as<JsonVariantConst>(), request.response)) {
+        return;
+      }
+
+      fn(request);
+    }
+  };
+};
@@ -0,0 +1,36 @@
+#include "KeepAlive.h"
+
+namespace RichHttp {
+  KeepAlivePolicy::KeepAlivePolicy(uint32_t idleTimeout, uint16_t maxRequests)
+    : idleTimeout(idleTimeout)
+    , maxRequests(maxRequests)
+    , address(0)
+    , port(0)
+    , requests(0)
+    , lastActivity(0)
+    , open(false)
+  { }
+
+  void KeepAlivePolicy::setMaxRequests(uint16_t maxRequests) {
+    this->maxRequests = maxRequests;
+  }
+
+  void KeepAlivePolicy::setIdleTimeout(uint32_t idleTimeout) {
+    this->idleTimeout = idleTimeout;
+  }
+
+  bool KeepAlivePolicy::onRequest(uint32_t address, uint16_t port, uint32_t now) {
+    // Otherwise this is the first request on a new connection
+    if (! open || address != this->address || port != this->port) {
+      this->address = address;
+      this->port = port;
+      requests = 0;
+    }
+
+    ++requests;
+    lastActivity = now;
+    open = requests < maxRequests;
+
+    return open;
+  }
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Milliseconds a persistent connection can wait for its next request before it's closed
+#ifndef RICH_HTTP_KEEP_ALIVE_TIMEOUT
+#define RICH_HTTP_KEEP_ALIVE_TIMEOUT 2000
+#endif
+
+// Requests served on a connection before it's closed
+#ifndef RICH_HTTP_KEEP_ALIVE_MAX_REQUESTS
+#define RICH_HTTP_KEEP_ALIVE_MAX_REQUESTS 100
+#endif
+
+// Most requests served from a connection in one handleClient() call, when they've been sent
+// without waiting for responses
+#ifndef RICH_HTTP_KEEP_ALIVE_PIPELINE_DEPTH
+#define RICH_HTTP_KEEP_ALIVE_PIPELINE_DEPTH 4
+#endif
+
+namespace RichHttp {
+  /**
+   * Decides when the builtin server's persistent connection is closed: after it has served
+   * a maximum number of requests, or when it's been idle for too long.  The server only
+   * handles one connection at a time, so only its current connection is tracked.
+   */
+  class KeepAlivePolicy {
+    public:
+      KeepAlivePolicy(
+        uint32_t idleTimeout = RICH_HTTP_KEEP_ALIVE_TIMEOUT,
+        uint16_t maxRequests = RICH_HTTP_KEEP_ALIVE_MAX_REQUESTS
+      );
+
+      // 0 disables persistent connections
+      void setMaxRequests(uint16_t maxRequests);
+      void setIdleTimeout(uint32_t idleTimeout);
+
+      inline uint16_t getMaxRequests() const { return maxRequests; }
+      inline uint32_t getIdleTimeout() const { return idleTimeout; }
+
+      // Called when a request from the client at address:port starts.  Returns true if the
+      // connection may stay open after the response.
+      bool onRequest(uint32_t address, uint16_t port, uint32_t now);
+
+      // Called when the response has been sent.  The idle timeout counts from here.
+      inline void onResponse(uint32_t now) { lastActivity = now; }
+
+      // Called when the connection is closed
+      inline void onClose() { open = false; }
+
+      // True if the current connection is staying open after its last response
+      inline bool isOpen() const { return open; }
+
+      // True if the current connection is open and has waited longer than the idle timeout
+      // for its next request
+      inline bool isIdle(uint32_t now) const {
+        return open && now - lastActivity > idleTimeout;
+      }
+
+    private:
+      uint32_t idleTimeout;
+      uint16_t maxRequests;
+
+      uint32_t address;
+      uint16_t port;
+      uint16_t requests;
+      uint32_t lastActivity;
+      bool open;
+  };
+};
@@ -0,0 +1,33 @@
+#include "Middleware.h"
+#include "Platforms/Generics.h"
+
+namespace RichHttp {
+  MiddlewarePipeline::MiddlewarePipeline()
+    : count(0)
+  { }
+
+  bool MiddlewarePipeline::add(Middleware& middleware) {
+    if (count >= RICH_HTTP_MAX_MIDDLEWARE) {
+      return false;
+    }
+
+    this->middleware[count++] = &middleware;
+    return true;
+  }
+
+  bool MiddlewarePipeline::before(Generics::RequestContext& request, size_t& entered) const {
+    for (entered = 0; entered < count; ) {
+      if (! middleware[entered++]->before(request)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  void MiddlewarePipeline::after(Generics::RequestContext& request, size_t entered) const {
+    while (entered > 0) {
+      middleware[--entered]->after(request);
+    }
+  }
+};
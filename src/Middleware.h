@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stddef.h>
+
+// Maximum number of middleware which can be added to a server with use()
+#ifndef RICH_HTTP_MAX_MIDDLEWARE
+#define RICH_HTTP_MAX_MIDDLEWARE 8
+#endif
+
+namespace RichHttp {
+  namespace Generics {
+    class RequestContext;
+  };
+
+  /**
+   * Cross-cutting request processing (headers, logging, timing, policy checks) which runs
+   * around every route's handler.  Written once against the platform-independent
+   * RequestContext, so the same middleware works with every backend.
+   *
+   * Middleware runs once per request, around the handler which produces the response.  It
+   * doesn't run for each chunk of an upload (the upload's request still goes through it once
+   * the upload is complete), or for routes added with onSimple(), which don't have a
+   * RequestContext.
+   */
+  class Middleware {
+    public:
+      virtual ~Middleware() = default;
+
+      // Called before the route's handler.  Return false to short-circuit: the handler and
+      // any later middleware are skipped, and whatever has been set on request.response is
+      // sent instead.
+      virtual bool before(Generics::RequestContext& request) { return true; }
+
+      // Called after the handler, before the response is sent.  Runs in reverse order for
+      // every middleware whose before() was called, including one which short-circuited.
+      virtual void after(Generics::RequestContext& request) { }
+  };
+
+  /**
+   * Ordered list of middleware shared by all of a server's routes.  Stored as a fixed array of
+   * pointers, so running it doesn't allocate or add closures.
+   */
+  class MiddlewarePipeline {
+    public:
+      MiddlewarePipeline();
+
+      // Returns false if RICH_HTTP_MAX_MIDDLEWARE has been reached.
+      bool add(Middleware& middleware);
+
+      inline size_t size() const { return count; }
+
+      // Runs before() for each middleware in order, stopping at the first which returns
+      // false.  entered is set to the number of middleware whose before() was called.
+      bool before(Generics::RequestContext& request, size_t& entered) const;
+
+      // Runs after() in reverse order for the first `entered` middleware.
+      void after(Generics::RequestContext& request, size_t entered) const;
+
+      /**
+       * Runs fn between before() and after(), skipping it if the pipeline short-circuits.  A
+       * null pipeline just runs fn.
+       */
+      template <class Fn, class TContext>
+      static void run(const MiddlewarePipeline* pipeline, Fn& fn, TContext& context) {
+        if (pipeline == nullptr || pipeline->count == 0) {
+          fn(context);
+          return;
+        }
+
+        size_t entered = 0;
+
+        if (pipeline->before(context, entered)) {
+          fn(context);
+        }
+
+        pipeline->after(context, entered);
+      }
+
+    private:
+      Middleware* middleware[RICH_HTTP_MAX_MIDDLEWARE];
+      size_t count;
+  };
+};
@@ -0,0 +1,104 @@
+#include "Pagination.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace RichHttp {
+  static const char CURSOR_PARAM[] = "cursor";
+  static const char LIMIT_PARAM[] = "limit";
+
+  // Parses a non-empty string of digits.  False if it's anything else or overflows.
+  static bool parseUint32(const char* value, uint32_t& result) {
+    if (value == nullptr || *value == 0) {
+      return false;
+    }
+
+    result = 0;
+
+    for (const char* c = value; *c != 0; ++c) {
+      if (*c < '0' || *c > '9') {
+        return false;
+      }
+
+      uint32_t digit = *c - '0';
+
+      if (result > (UINT32_MAX - digit) / 10) {
+        return false;
+      }
+      result = result * 10 + digit;
+    }
+
+    return true;
+  }
+
+  // Appends value percent-encoded for use in a query string
+  static void appendEncoded(String& dest, const char* value) {
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+    for (const char* c = value; *c != 0; ++c) {
+      if (isalnum(static_cast<unsigned char>(*c)) || strchr("-._~", *c) != nullptr) {
+        dest += *c;
+      } else {
+        dest += '%';
+        dest += HEX_DIGITS[(static_cast<uint8_t>(*c) >> 4) & 0xF];
+        dest += HEX_DIGITS[static_cast<uint8_t>(*c) & 0xF];
+      }
+    }
+  }
+
+  Page::Page(QueryParams& queryParams, Response& response)
+    : queryParams(queryParams)
+    , response(response)
+    , cursor(0)
+    , limit(RICH_HTTP_PAGE_DEFAULT_LIMIT)
+    , valid(true)
+  {
+    const char* cursorValue = queryParams.get(CURSOR_PARAM);
+    const char* limitValue = queryParams.get(LIMIT_PARAM);
+    uint32_t parsedLimit;
+
+    if (cursorValue != nullptr && ! parseUint32(cursorValue, cursor)) {
+      valid = false;
+    }
+
+    if (limitValue != nullptr) {
+      if (parseUint32(limitValue, parsedLimit) && parsedLimit > 0) {
+        limit = parsedLimit < RICH_HTTP_PAGE_MAX_LIMIT ? parsedLimit : RICH_HTTP_PAGE_MAX_LIMIT;
+      } else {
+        valid = false;
+      }
+    }
+  }
+
+  bool Page::finish() {
+    String link;
+    link += '?';
+
+    for (size_t i = 0; i < queryParams.size(); ++i) {
+      const char* name = queryParams.nameAt(i);
+
+      if (strcmp(name, CURSOR_PARAM) != 0 && strcmp(name, LIMIT_PARAM) != 0) {
+        appendEncoded(link, name);
+        link += '=';
+        appendEncoded(link, queryParams.valueAt(i));
+        link += '&';
+      }
+    }
+
+    link += LIMIT_PARAM;
+    link += '=';
+    link += String(static_cast<unsigned long>(limit));
+    link += '&';
+    link += CURSOR_PARAM;
+    link += '=';
+    link += String(static_cast<unsigned long>(cursor));
+
+    response.json["next"] = link;
+    String header = F("<");
+    header += link;
+    header += F(">; rel=\"next\"");
+    response.addHeader(F("Link"), header);
+
+    return true;
+  }
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "QueryParams.h"
+#include "RichResponse.h"
+
+// Number of items in a page when the request doesn't specify a limit
+#ifndef RICH_HTTP_PAGE_DEFAULT_LIMIT
+#define RICH_HTTP_PAGE_DEFAULT_LIMIT 20
+#endif
+
+// Largest limit a request can ask for.  Pages are also cut short when the response document
+// is nearly full.
+#ifndef RICH_HTTP_PAGE_MAX_LIMIT
+#define RICH_HTTP_PAGE_MAX_LIMIT 100
+#endif
+
+// Bytes of the response document kept free for the "next" link
+#ifndef RICH_HTTP_PAGE_LINK_RESERVE
+#define RICH_HTTP_PAGE_LINK_RESERVE 96
+#endif
+
+namespace RichHttp {
+  /**
+   * One page of a collection, rendered into a response as:
+   *
+   *   {"items":[...],"next":"?limit=20&cursor=40"}
+   *
+   * The cursor is an opaque 32-bit position chosen by the collection (an index, an id, an
+   * offset into a file, ...).  "next" is a link relative to the current URL which keeps the
+   * request's other query parameters, and is omitted on the last page.  It's also sent as a
+   * Link header, which is present even if the document had no room left for it.
+   *
+   * Items are added until the limit is reached, the collection ends, or the document doesn't
+   * have room for another item of the largest size seen so far, so the page never holds
+   * more than fits in the response.
+   */
+  class Page {
+    public:
+      Page(QueryParams& queryParams, Response& response);
+
+      // False if the request's cursor or limit isn't valid, in which case a 400 should be sent.
+      inline bool isValid() const { return valid; }
+
+      inline uint32_t getCursor() const { return cursor; }
+      inline size_t getLimit() const { return limit; }
+
+      /**
+       * Fills the page by calling next(cursor, item) for each item.  next fills item with the
+       * item at cursor, sets cursor to the position of the following item, and returns true,
+       * or returns false if there are no more items.
+       *
+       * Returns false if the first item doesn't fit in the response document.
+       */
+      template <class Fn>
+      bool fill(Fn next) {
+        JsonDocument& doc = response.json;
+        JsonArray items = doc.createNestedArray("items");
+        size_t largestItem = 0;
+        size_t count = 0;
+
+        while (count < limit) {
+          size_t usedBefore = doc.memoryUsage();
+          uint32_t cursorBefore = cursor;
+          JsonVariant item = items.add();
+
+          if (! next(cursor, item)) {
+            items.remove(count);
+            return true;
+          }
+
+          // The item (or its slot in the array) didn't fit, so it'll be the first of the next page
+          if (doc.overflowed()) {
+            items.remove(count);
+            cursor = cursorBefore;
+            return count > 0 && finish();
+          }
+
+          ++count;
+
+          size_t itemSize = doc.memoryUsage() - usedBefore;
+          if (itemSize > largestItem) {
+            largestItem = itemSize;
+          }
+
+          if (doc.capacity() - doc.memoryUsage() < largestItem + RICH_HTTP_PAGE_LINK_RESERVE) {
+            break;
+          }
+        }
+
+        return finish();
+      }
+
+    private:
+      QueryParams& queryParams;
+      Response& response;
+      uint32_t cursor;
+      size_t limit;
+      bool valid;
+
+      // Adds links to the next page.  Always returns true.
+      bool finish();
+  };
+};
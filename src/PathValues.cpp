@@ -0,0 +1,148 @@
+#include "PathValues.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace RichHttp {
+  // Longest value accepted for a float variable
+  static const size_t MAX_FLOAT_LENGTH = 24;
+
+  static bool parseUint(const char* value, size_t length, unsigned long& result) {
+    if (length == 0) {
+      return false;
+    }
+
+    result = 0;
+
+    for (size_t i = 0; i < length; ++i) {
+      if (value[i] < '0' || value[i] > '9') {
+        return false;
+      }
+
+      unsigned long digit = value[i] - '0';
+
+      if (result > (ULONG_MAX - digit) / 10) {
+        return false;
+      }
+      result = result * 10 + digit;
+    }
+
+    return true;
+  }
+
+  static bool parseInt(const char* value, size_t length, long& result) {
+    bool negative = length > 0 && value[0] == '-';
+    unsigned long magnitude;
+
+    if (! parseUint(value + (negative ? 1 : 0), length - (negative ? 1 : 0), magnitude)) {
+      return false;
+    }
+
+    if (negative) {
+      if (magnitude > static_cast<unsigned long>(LONG_MAX) + 1) {
+        return false;
+      }
+      result = static_cast<long>(0 - magnitude);
+    } else {
+      if (magnitude > static_cast<unsigned long>(LONG_MAX)) {
+        return false;
+      }
+      result = static_cast<long>(magnitude);
+    }
+
+    return true;
+  }
+
+  static bool parseFloat(const char* value, size_t length, float& result) {
+    char buffer[MAX_FLOAT_LENGTH + 1];
+
+    if (length == 0 || length > MAX_FLOAT_LENGTH) {
+      return false;
+    }
+
+    memcpy(buffer, value, length);
+    buffer[length] = 0;
+
+    char* end;
+    result = strtof(buffer, &end);
+
+    return *end == 0 && isfinite(result);
+  }
+
+  // Float to integer conversions outside of the target's range are undefined.  The limit is
+  // exclusive: LONG_MAX and ULONG_MAX round up to a power of two as floats, which is out of
+  // range, but LONG_MIN is exact.
+  static bool inRange(float value, float min, float limit) {
+    return value >= min && value < limit;
+  }
+
+  static const float LONG_LIMIT = -static_cast<float>(LONG_MIN);
+  static const float ULONG_LIMIT = 2 * LONG_LIMIT;
+
+  PathValues::PathValues()
+    : count(0)
+  { }
+
+  void PathValues::reset() {
+    count = 0;
+  }
+
+  long PathValues::getInt(size_t index) const {
+    switch (typeAt(index)) {
+      case PathVariableType::INT: return values[index].i;
+      case PathVariableType::UINT: return static_cast<long>(values[index].u);
+      case PathVariableType::FLOAT:
+        return inRange(values[index].f, LONG_MIN, LONG_LIMIT) ? static_cast<long>(values[index].f) : 0;
+      default: return 0;
+    }
+  }
+
+  unsigned long PathValues::getUint(size_t index) const {
+    switch (typeAt(index)) {
+      case PathVariableType::INT: return static_cast<unsigned long>(values[index].i);
+      case PathVariableType::UINT: return values[index].u;
+      case PathVariableType::FLOAT:
+        return inRange(values[index].f, 0, ULONG_LIMIT) ? static_cast<unsigned long>(values[index].f) : 0;
+      default: return 0;
+    }
+  }
+
+  float PathValues::getFloat(size_t index) const {
+    switch (typeAt(index)) {
+      case PathVariableType::INT: return static_cast<float>(values[index].i);
+      case PathVariableType::UINT: return static_cast<float>(values[index].u);
+      case PathVariableType::FLOAT: return values[index].f;
+      default: return 0;
+    }
+  }
+
+  bool PathValues::parse(PathVariableType type, const char* value, size_t length, PathValues* values, size_t index) {
+    Value parsed;
+    bool valid;
+
+    parsed.u = 0;
+
+    switch (type) {
+      case PathVariableType::STRING: valid = true; break;
+      case PathVariableType::INT: valid = parseInt(value, length, parsed.i); break;
+      case PathVariableType::UINT: valid = parseUint(value, length, parsed.u); break;
+      case PathVariableType::FLOAT: valid = parseFloat(value, length, parsed.f); break;
+      default: valid = false; break;
+    }
+
+    if (valid && values != nullptr && index < RICH_HTTP_MAX_PATH_VARIABLES) {
+      // Variables are parsed in order, so any skipped ones are untyped
+      while (values->count < index) {
+        values->types[values->count++] = PathVariableType::STRING;
+      }
+
+      values->values[index] = parsed;
+      values->types[index] = type;
+      values->count = index + 1;
+    }
+
+    return valid;
+  }
+};
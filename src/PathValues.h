@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of variables in a route's path
+#ifndef RICH_HTTP_MAX_PATH_VARIABLES
+#define RICH_HTTP_MAX_PATH_VARIABLES 8
+#endif
+
+namespace RichHttp {
+  /**
+   * Type of a path variable, declared by following its name with e.g. "<uint>":
+   *
+   *   /things/:thing_id<uint>
+   *
+   * Requests with a value that isn't valid for the type don't match the route.
+   */
+  enum class PathVariableType : uint8_t {
+    STRING,
+    INT,
+    UINT,
+    FLOAT,
+
+    // An unrecognized type.  Routes with one never match.
+    INVALID
+  };
+
+  /**
+   * Typed path variables of the matched route, converted while the request was matched.
+   * Variables are indexed by their position in the path, counting untyped variables.
+   */
+  class PathValues {
+    public:
+      PathValues();
+
+      inline size_t size() const { return count; }
+      inline PathVariableType typeAt(size_t index) const {
+        return index < count ? types[index] : PathVariableType::STRING;
+      }
+
+      // Values of other numeric types are converted.  0 for untyped variables, out of range
+      // indexes and floats which don't fit.
+      long getInt(size_t index) const;
+      unsigned long getUint(size_t index) const;
+      float getFloat(size_t index) const;
+
+      void reset();
+
+      /**
+       * Checks that value is valid for type.  If values is non-null, the converted value is
+       * stored as its index-th variable.
+       */
+      static bool parse(PathVariableType type, const char* value, size_t length, PathValues* values, size_t index);
+
+    private:
+      union Value {
+        long i;
+        unsigned long u;
+        float f;
+      };
+
+      Value values[RICH_HTTP_MAX_PATH_VARIABLES];
+      PathVariableType types[RICH_HTTP_MAX_PATH_VARIABLES];
+      uint8_t count;
+  };
+};
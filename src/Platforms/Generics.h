@@ -9,6 +9,17 @@
 
 #include "../RichResponse.h"
 #include "../AuthProviders.h"
+#include "../HeapStats.h"
+#include "../Middleware.h"
+#include "../RouteMethods.h"
+#include "../CorsPolicy.h"
+#include "../AccessLog.h"
+#include "../QueryParams.h"
+#include "../FieldSelection.h"
+#include "../PathValues.h"
+#include "../RouteTable.h"
+#include "../UploadSink.h"
+#include "../HeaderSet.h"
 
 #ifndef RICH_HTTP_REQUEST_BUFFER_SIZE
 #define RICH_HTTP_REQUEST_BUFFER_SIZE 1024
@@ -81,55 +92,131 @@ namespace RichHttp {
     >
     class HandlerFnWrapperBuilder {
       public:
-        HandlerFnWrapperBuilder(TServerType* server, const AuthProvider* authProvider)
-          : server(server)
+        HandlerFnWrapperBuilder(
+          TServerType* server,
+          const AuthProvider* authProvider,
+          const MiddlewarePipeline* middleware = nullptr,
+          const RouteMethods* routeMethods = nullptr,
+          const CorsPolicy* cors = nullptr
+        ) : server(server)
           , authProvider(authProvider)
+          , middleware(middleware)
+          , routeMethods(routeMethods)
+          , cors(cors)
+          , accessLog(nullptr)
+          , collectedHeaders(nullptr)
+          , responseCount(0)
         {}
 
         virtual typename TMethodWrapper::type buildAuthedFn(typename TMethodWrapper::type) = 0;
         virtual typename TBodyMethodWrapper::type buildAuthedBodyFn(typename TBodyMethodWrapper::type) = 0;
         virtual typename TUploadMethodWrapper::type buildAuthedUploadFn(typename TUploadMethodWrapper::type) = 0;
 
-        virtual typename TBodyMethodWrapper::type wrapContextFn(typename TContextHandler::type, bool disableBody) = 0;
+        // stats may be null, in which case heap usage is not recorded.  Requests served by the
+        // returned fn are logged without a route id.
+        virtual typename TBodyMethodWrapper::type wrapContextFn(typename TContextHandler::type, bool disableBody, RouteHeapStats* stats) = 0;
         virtual typename TUploadMethodWrapper::type wrapUploadContextFn(typename TUploadContextHandler::type) = 0;
 
+        // Requests served through handleContextFn, and requests rejected or answered without a
+        // route, are recorded in log.  Pass null to stop.
+        void setAccessLog(AccessLog* accessLog) {
+          this->accessLog = accessLog;
+        }
+
+        // Request headers routes read.  Others aren't kept.  Called again whenever headers
+        // change.
+        virtual void setCollectedHeaders(HeaderSet* headers) {
+          this->collectedHeaders = headers;
+        }
+
+        // Number of responses sent by routes, and to requests rejected or answered without a
+        // route.  Wraps around.
+        inline uint32_t getResponseCount() const { return responseCount; }
+
+        // True if GET routes should also answer HEAD requests for the path with this id (see
+        // RouteMethods::add())
+        bool servesHeadAsGet(size_t pathId) const {
+          return routeMethods != nullptr && RouteMethods::servesHeadAsGet(routeMethods->methodsOf(pathId));
+        }
+
       protected:
         TServerType* server;
         const AuthProvider* authProvider;
+        const MiddlewarePipeline* middleware;
+        const RouteMethods* routeMethods;
+        const CorsPolicy* cors;
+        AccessLog* accessLog;
+        HeaderSet* collectedHeaders;
+        uint32_t responseCount;
+
+        bool isCorsEnabled() const {
+          return cors != nullptr && cors->isEnabled();
+        }
+
+        // Records a response sent without running a route's handler, e.g. a rejection or an
+        // answer to a preflight request
+        void recordResponse(uint32_t client, uint8_t method, uint16_t status, uint16_t routeId) {
+          if (accessLog != nullptr) {
+            accessLog->record(AccessLogEntry{
+              .timestamp = static_cast<uint32_t>(millis()),
+              .client = client,
+              .bytes = 0,
+              .latency = 0,
+              .route = routeId,
+              .status = status,
+              .method = method
+            });
+          }
+        }
     };
 
+    /**
+     * Matches requests against a single route's method and path pattern.  Variables with a
+     * type (e.g. ":id<uint>") only match values which are valid for it.
+     */
     template <class Config, class THandlerClass>
-    class BaseRequestHandler : public THandlerClass {
+    class BasePathHandler : public THandlerClass {
       public:
-        BaseRequestHandler(
+        BasePathHandler(
           typename Config::HttpMethod anyMethod,
           typename Config::HttpMethod method,
-          const char* _path,
-          typename Config::RequestHandlerFn::type handlerFn,
-          typename Config::BodyRequestHandlerFn::type bodyFn = NULL,
-          typename Config::UploadRequestHandlerFn::type uploadFn = NULL
+          const char* _path
         ) : anyMethod(anyMethod)
           , method(method)
-          , handlerFn(handlerFn)
-          , bodyFn(bodyFn)
-          , uploadFn(uploadFn)
         {
-          patternTokens = std::make_shared<TokenIterator>(_path, strlen(_path), '/');
+          String pattern = Routes::parsePattern(_path, types);
+          patternTokens = std::make_shared<TokenIterator>(pattern.c_str(), pattern.length(), '/');
         }
 
-        virtual ~BaseRequestHandler() = default;
+        virtual ~BasePathHandler() = default;
 
-        bool canHandlePath(const char* requestPath, size_t length) {
+        // Typed variables are converted into values if it's non-null
+        bool canHandlePath(const char* requestPath, size_t length, PathValues* values = nullptr) {
           TokenIterator requestTokens(requestPath, length, '/');
 
           bool canHandle = true;
+          size_t variable = 0;
+
+          if (values != nullptr) {
+            values->reset();
+          }
 
           patternTokens->reset();
           while (patternTokens->hasNext() && requestTokens.hasNext()) {
             const char* patternToken = patternTokens->nextToken();
             const char* requestToken = requestTokens.nextToken();
 
-            if (patternToken[0] != ':' && strcmp(patternToken, requestToken) != 0) {
+            if (patternToken[0] == ':') {
+              if (variable < RICH_HTTP_MAX_PATH_VARIABLES
+                && (values != nullptr || types[variable] != PathVariableType::STRING)
+                && !PathValues::parse(types[variable], requestToken, strlen(requestToken), values, variable))
+              {
+                canHandle = false;
+                break;
+              }
+
+              ++variable;
+            } else if (strcmp(patternToken, requestToken) != 0) {
               canHandle = false;
               break;
             }
@@ -143,39 +230,116 @@ namespace RichHttp {
           return canHandle;
         }
 
-        virtual bool _canHandle(typename Config::HttpMethod requestMethod, const char* path, size_t length) {
+        virtual bool _canHandle(
+          typename Config::HttpMethod requestMethod,
+          const char* path,
+          size_t length,
+          PathValues* values = nullptr
+        ) {
           if (this->method != this->anyMethod && requestMethod != this->method) {
             return false;
           }
 
-          return this->canHandlePath(path, length);
+          return this->canHandlePath(path, length, values);
         }
 
       protected:
         typename Config::HttpMethod anyMethod;
         typename Config::HttpMethod method;
+        ::std::shared_ptr<TokenIterator> patternTokens;
+        PathVariableType types[RICH_HTTP_MAX_PATH_VARIABLES];
+    };
+
+    template <class Config, class THandlerClass>
+    class BaseRequestHandler : public BasePathHandler<Config, THandlerClass> {
+      public:
+        BaseRequestHandler(
+          typename Config::HttpMethod anyMethod,
+          typename Config::HttpMethod method,
+          const char* _path,
+          typename Config::RequestHandlerFn::type handlerFn,
+          typename Config::BodyRequestHandlerFn::type bodyFn = NULL,
+          typename Config::UploadRequestHandlerFn::type uploadFn = NULL
+        ) : BasePathHandler<Config, THandlerClass>(anyMethod, method, _path)
+          , handlerFn(handlerFn)
+          , bodyFn(bodyFn)
+          , uploadFn(uploadFn)
+        { }
+
+      protected:
         typename Config::RequestHandlerFn::type handlerFn;
         typename Config::BodyRequestHandlerFn::type bodyFn;
         typename Config::UploadRequestHandlerFn::type uploadFn;
-        ::std::shared_ptr<TokenIterator> patternTokens;
     };
 
+    /**
+     * Placeholder for the upload handler of a compiled handler which doesn't accept uploads.
+     */
+    struct NoUploadFn {
+      template <class TContext>
+      void operator()(TContext&) const { }
+    };
+
+    /**
+     * Upload handler which passes chunks straight to an UploadSink, without building a
+     * request context for each one.
+     */
+    struct UploadSinkFn {
+      UploadSink* sink;
+    };
+
+    template <class Fn>
+    struct UploadFnTraits {
+      static constexpr bool hasUpload = true;
+    };
+
+    template <>
+    struct UploadFnTraits<NoUploadFn> {
+      static constexpr bool hasUpload = false;
+    };
+
+    // True for callables which can be empty and are, e.g. a default constructed std::function
+    // or a null function pointer.  Other callables are never empty.
+    template <class Fn>
+    inline bool isEmptyFn(const Fn&) {
+      return false;
+    }
+
+    template <class R, class... Args>
+    inline bool isEmptyFn(const std::function<R(Args...)>& fn) {
+      return ! fn;
+    }
+
+    template <class R, class... Args>
+    inline bool isEmptyFn(R (*fn)(Args...)) {
+      return fn == nullptr;
+    }
+
     class RequestContext {
       public:
         RequestContext(
           Response& _response,
+          QueryParams& queryParams,
           const UrlTokenBindings& pathVariables,
+          const PathValues& pathValues,
           bool hasBody
         ) : response(_response)
+          , queryParams(queryParams)
           , pathVariables(pathVariables)
+          , pathValues(pathValues)
           , jsonBody(nullptr)
           , _hasBody(hasBody)
           , _bodyLoaded(false)
+          , _jsonBodyInvalid(false)
         { }
 
         Response& response;
+        QueryParams& queryParams;
         const UrlTokenBindings& pathVariables;
 
+        // Values of typed path variables, by position in the route's path
+        const PathValues& pathValues;
+
         virtual JsonDocument& getJsonBody() {
           if (jsonBody == nullptr) {
             jsonBody = parseJsonBody();
@@ -185,7 +349,7 @@ namespace RichHttp {
 
         virtual const char* getBody() {
           _loadBody();
-          return *body;
+          return body;
         }
 
         virtual size_t getBodyLength() {
@@ -197,6 +361,16 @@ namespace RichHttp {
           return this->_hasBody;
         }
 
+        // True if getJsonBody() couldn't parse the body, in which case the response has been
+        // set to a 400
+        bool isJsonBodyInvalid() const {
+          return this->_jsonBodyInvalid;
+        }
+
+        // Only headers declared with HandlerBuilder::collectHeader() are available
+        virtual bool hasHeader(const char* name) = 0;
+        virtual String getHeader(const char* name) = 0;
+
       protected:
         virtual std::shared_ptr<JsonDocument> parseJsonBody() {
           std::shared_ptr<JsonDocument> jsonPtr = std::make_shared<DynamicJsonDocument>(RICH_HTTP_RESPONSE_BUFFER_SIZE);
@@ -207,6 +381,7 @@ namespace RichHttp {
             err["message"] = "Error parsing JSON";
             err["id"] = error.c_str();
             response.setCode(400);
+            _jsonBodyInvalid = true;
           }
 
           return jsonPtr;
@@ -217,15 +392,16 @@ namespace RichHttp {
       private:
         std::shared_ptr<UrlTokenBindings> pathBindings;
         std::shared_ptr<JsonDocument> jsonBody;
-        const char** body;
+        const char* body;
         size_t bodyLength;
         bool _hasBody;
         bool _bodyLoaded;
+        bool _jsonBodyInvalid;
 
         void _loadBody() {
           if (! this->_bodyLoaded) {
             std::pair<const char*, size_t> body = loadBody();
-            this->body = &body.first;
+            this->body = body.first;
             this->bodyLength = body.second;
             this->_bodyLoaded = true;
           }
@@ -1,5 +1,6 @@
 #if defined(_ESPAsyncWebServer_H_) || defined(RICH_HTTP_ASYNC_WEBSERVER)
 #include "PlatformAsyncWebServer.h"
+#include "../DeltaUpdate.h"
 
 #if defined(ESP8266)
 #include <Updater.h>
@@ -52,4 +53,45 @@ const __fn_type _Config::OtaSuccessHandlerFn = [](__context_type context) {
   ESP.restart();
 };
 
+const __fn_type _Config::DeltaOtaHandlerFn = [](__context_type context) {
+  if (context.upload.index == 0) {
+#if defined(ESP8266)
+    Update.runAsync(true);
+#endif
+    RichHttp::Delta::beginUpdate();
+  }
+
+  if (RichHttp::Delta::hasUpdateError()) {
+    // Aborts Update if it's somehow still running, so the next delta update can begin
+    if (context.upload.isFinal) {
+      RichHttp::Delta::endUpdate();
+    }
+    return;
+  }
+
+  if (! RichHttp::Delta::writeUpdate(context.upload.data, context.upload.length)) {
+    RichHttp::Delta::printUpdateError(Serial);
+    RichHttp::Delta::endUpdate();
+    return;
+  }
+
+  if (context.upload.isFinal && ! RichHttp::Delta::endUpdate()) {
+    RichHttp::Delta::printUpdateError(Serial);
+  }
+};
+
+const __fn_type _Config::DeltaOtaSuccessHandlerFn = [](__context_type context) {
+  if (RichHttp::Delta::hasUpdateError()) {
+    // The running sketch is untouched, so there's no reason to restart.
+    context.rawRequest->send(500, "text/plain", RichHttp::Delta::errorToString(RichHttp::Delta::getUpdateError()));
+    return;
+  }
+
+  context.rawRequest->send(200, "text/plain", "success");
+
+  delay(1000);
+
+  ESP.restart();
+};
+
 #endif
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "Generics.h"
+#include "../RouteTable.h"
+#include "../SwappableRoutes.h"
+#include "../AdmissionControl.h"
+#include <algorithm>
 #include <functional>
 
 #if defined(_ESPAsyncWebServer_H_) || defined(RICH_HTTP_ASYNC_WEBSERVER)
@@ -13,8 +17,6 @@
 
 namespace RichHttp {
   namespace Generics {
-    class AsyncRequestContext;
-
     struct BodyArgs {
       uint8_t* data;
       size_t length;
@@ -41,6 +43,74 @@ namespace RichHttp {
     // Use when creating a request context with no upload
     static const String NULL_FILENAME;
 
+    /**
+     * Query parameters parsed by the server.  Form fields and files are excluded.
+     */
+    class AsyncQueryParams : public QueryParams {
+      public:
+        AsyncQueryParams(AsyncWebServerRequest* request)
+          : request(request)
+        { }
+
+      protected:
+        virtual void load() override {
+          size_t numParams = request->params();
+
+          for (size_t i = 0; i < numParams; ++i) {
+            AsyncWebParameter* param = request->getParam(i);
+
+            if (! param->isPost() && ! param->isFile()) {
+              add(param->name().c_str(), param->value().c_str());
+            }
+          }
+        }
+
+      private:
+        AsyncWebServerRequest* request;
+    };
+
+    class AsyncRequestContext : public RequestContext {
+      public:
+        template <class... Args>
+        AsyncRequestContext(
+          BodyArgs bodyArgs,
+          UploadArgs uploadArgs,
+          AsyncWebServerRequest* request,
+          Response& response,
+          Args&&... args
+        ) : RequestContext(response, _queryParams, std::forward<Args>(args)...)
+          , body(bodyArgs)
+          , upload(uploadArgs)
+          , rawRequest(request)
+          , _queryParams(request)
+        { }
+
+        virtual std::pair<const char*, size_t> loadBody() override {
+          return std::make_pair(reinterpret_cast<const char*>(body.data), body.length);
+        }
+
+        virtual bool hasHeader(const char* name) override {
+          return rawRequest->hasHeader(name);
+        }
+
+        virtual String getHeader(const char* name) override {
+          return rawRequest->header(name);
+        }
+
+        const BodyArgs body;
+        const UploadArgs upload;
+        AsyncWebServerRequest* rawRequest;
+
+      private:
+        AsyncQueryParams _queryParams;
+        String loadedBody;
+    };
+
+    // Identifies the request's upload to an UploadSink
+    inline const void* uploadOwner(AsyncRequestContext& context) {
+      return context.rawRequest;
+    }
+
     namespace AsyncFns {
       using handler_type = RichHttp::Generics::FunctionWrapper<void, AsyncWebServerRequest*, const UrlTokenBindings*>;
       using body_handler_type = RichHttp::Generics::FunctionWrapper<
@@ -65,6 +135,61 @@ namespace RichHttp {
       using context_fn_type = FunctionWrapper<void, AsyncRequestContext&>;
     };
 
+    /**
+     * Response to a HEAD request: the headers the body would have been sent with, including
+     * its Content-Length, without the body.  A basic response with an empty body can't be
+     * used, since it would send Content-Length bytes from its (empty) content.
+     */
+    class AsyncHeadResponse : public AsyncWebServerResponse {
+      public:
+        AsyncHeadResponse(int code, const String& contentType, size_t length)
+          : written(0)
+        {
+          _code = code;
+          _contentType = contentType;
+          _contentLength = length;
+        }
+
+        virtual bool _sourceValid() const override { return true; }
+
+        virtual void _respond(AsyncWebServerRequest* request) override {
+#if defined(ASYNCWEBSERVER_VERSION_MAJOR) && ASYNCWEBSERVER_VERSION_MAJOR >= 3
+          _assembleHead(head, request->version());
+#else
+          head = _assembleHead(request->version());
+#endif
+          _state = RESPONSE_HEADERS;
+          _ack(request, 0, 0);
+        }
+
+        virtual size_t _ack(AsyncWebServerRequest* request, size_t len, uint32_t time) override {
+          _ackedLength += len;
+
+          if (_state == RESPONSE_HEADERS) {
+            size_t n = std::min(request->client()->space(), head.length() - written);
+            written += request->client()->write(head.c_str() + written, n);
+            _writtenLength = written;
+
+            if (written == head.length()) {
+              head = String();
+              _state = RESPONSE_WAIT_ACK;
+            }
+
+            return n;
+          }
+
+          if (_state == RESPONSE_WAIT_ACK && _ackedLength >= _writtenLength) {
+            _state = RESPONSE_END;
+          }
+
+          return 0;
+        }
+
+      private:
+        String head;
+        size_t written;
+    };
+
     template <
       class TServerType = AsyncWebServer,
       class THandler = AsyncFns::handler_type,
@@ -93,6 +218,7 @@ namespace RichHttp {
         using body_fn_type = typename TBodyHandler::type;
         using upload_fn_type = typename TUploadHandler::type;
         using context_fn_type = typename TContextHandler::type;
+        using not_found_fn_type = ArRequestHandlerFunction;
 
         virtual fn_type buildAuthedFn(fn_type fn) override {
           return buildAuthedHandler(fn);
@@ -106,8 +232,8 @@ namespace RichHttp {
           return buildAuthedHandler(fn);
         }
 
-        virtual body_fn_type wrapContextFn(context_fn_type fn, bool disableBody) override {
-          return [this, fn, disableBody](
+        virtual body_fn_type wrapContextFn(context_fn_type fn, bool disableBody, RouteHeapStats* stats) override {
+          return [this, fn, disableBody, stats](
             AsyncWebServerRequest* request,
             const UrlTokenBindings* bindings,
             uint8_t* data,
@@ -115,29 +241,18 @@ namespace RichHttp {
             size_t index,
             size_t total
           ) {
-            DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
-            Response response(responseDoc);
-
             bool hasBody = !disableBody && length > 0;
 
-            AsyncRequestContext context(
-              BodyArgs{ .data = data, .length = length, .index = index, .total = total },
-              UploadArgs{
-                .filename = NULL_FILENAME,
-                .index = 0,
-                .data = nullptr,
-                .length = 0,
-                .isFinal = true
-              },
+            handleContextFn(
+              fn,
               request,
-              response,
               *bindings,
-              hasBody
+              PathValues(),
+              BodyArgs{ .data = data, .length = length, .index = index, .total = total },
+              hasBody,
+              stats,
+              AccessLog::NO_ROUTE
             );
-
-            fn(context);
-
-            sendResponse(request, response);
           };
         }
 
@@ -151,11 +266,11 @@ namespace RichHttp {
             size_t length,
             bool isFinal
           ) {
-            DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
-            Response response(responseDoc);
-
-            AsyncRequestContext context(
-              BodyArgs{ .data = nullptr, .length = 0, .index = 0, .total = 0 },
+            handleUploadContextFn(
+              fn,
+              request,
+              *bindings,
+              PathValues(),
               UploadArgs{
                 .filename = filename,
                 .index = index,
@@ -163,26 +278,319 @@ namespace RichHttp {
                 .length = length,
                 .isFinal = isFinal
               },
-              request,
-              response,
-              *bindings,
-              false
+              nullptr
             );
+          };
+        }
+
+        // Runs a context handler against a request and sends its response.
+        template <class Fn>
+        void handleContextFn(
+          Fn& fn,
+          AsyncWebServerRequest* request,
+          const UrlTokenBindings& bindings,
+          const PathValues& values,
+          const BodyArgs& body,
+          bool hasBody,
+          RouteHeapStats* stats,
+          uint16_t routeId
+        ) {
+          HeapProbe probe(stats);
+          uint32_t startedAt = this->accessLog != nullptr ? micros() : 0;
+
+          DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
+          Response response(responseDoc);
+
+          AsyncRequestContext context(
+            body,
+            UploadArgs{
+              .filename = NULL_FILENAME,
+              .index = 0,
+              .data = nullptr,
+              .length = 0,
+              .isFinal = true
+            },
+            request,
+            response,
+            bindings,
+            values,
+            hasBody
+          );
 
-            fn(context);
+          probe.handlerStarted();
+          MiddlewarePipeline::run(this->middleware, fn, context);
+          probe.handlerFinished();
 
+          size_t bytes = sendResponse(request, response, &context.queryParams);
+          probe.responseSent();
+          ++this->responseCount;
+
+          if (this->accessLog != nullptr) {
+            uint32_t latency = micros() - startedAt;
+
+            this->accessLog->record(AccessLogEntry{
+              .timestamp = static_cast<uint32_t>(millis() - latency / 1000),
+              .client = request->client()->remoteIP(),
+              .bytes = static_cast<uint32_t>(bytes),
+              .latency = latency,
+              .route = routeId,
+              .status = static_cast<uint16_t>(response.getCode()),
+              .method = methodBit(request->method())
+            });
+          }
+        }
+
+        template <class Fn>
+        void handleUploadContextFn(
+          Fn& fn,
+          AsyncWebServerRequest* request,
+          const UrlTokenBindings& bindings,
+          const PathValues& values,
+          const UploadArgs& upload,
+          RouteHeapStats* stats
+        ) {
+          UploadHeapProbe probe(stats);
+
+          DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
+          Response response(responseDoc);
+
+          AsyncRequestContext context(
+            BodyArgs{ .data = nullptr, .length = 0, .index = 0, .total = 0 },
+            upload,
+            request,
+            response,
+            bindings,
+            values,
+            false
+          );
+
+          fn(context);
+
+          // Runs for every chunk, so a code alone is left for the request's handler to report
+          // once the upload is complete
+          if (response.hasContent()) {
             sendResponse(request, response);
-          };
+          }
+        }
+
+        // Drops the request's headers which routes haven't declared.  Called from canHandle()
+        // when a route matches, which is after ESPAsyncWebServer has parsed and stored every
+        // header, so they're freed rather than never stored.
+        void filterHeaders(AsyncWebServerRequest* request) {
+          if (this->collectedHeaders == nullptr) {
+            return;
+          }
+
+#if defined(ASYNCWEBSERVER_VERSION_MAJOR) && ASYNCWEBSERVER_VERSION_MAJOR >= 3
+          // Every header is stored, so the best we can do is free the undeclared ones
+          for (size_t i = request->headers(); i-- > 0; ) {
+            const AsyncWebHeader* header = request->getHeader(i);
+
+            if (header != nullptr
+              && ! this->collectedHeaders->contains(header->name().c_str())
+              && ! header->name().equalsIgnoreCase(F("Authorization")))
+            {
+              String name = header->name();
+              request->removeHeader(name.c_str());
+            }
+          }
+#else
+          // Headers which aren't interesting are removed once the handler has been attached
+          for (size_t i = 0; i < this->collectedHeaders->size(); ++i) {
+            request->addInterestingHeader(this->collectedHeaders->at(i));
+          }
+#endif
         }
 
-        void sendResponse(AsyncWebServerRequest* request, RichHttp::Response& response) {
-          if (response.isSetBody()) {
-            request->send(response.getCode(), response.getBodyType(), response.getBody());
+        // Feeds each chunk of the upload to the sink, which tells concurrent uploads apart by
+        // their request.
+        void handleUploadContextFn(
+          UploadSinkFn& fn,
+          AsyncWebServerRequest* request,
+          const UrlTokenBindings&,
+          const PathValues&,
+          const UploadArgs& upload,
+          RouteHeapStats* stats
+        ) {
+          UploadHeapProbe probe(stats);
+
+          if (upload.index == 0) {
+            fn.sink->begin(request);
+          }
+
+          fn.sink->write(request, upload.data, upload.length);
+
+          if (upload.isFinal) {
+            fn.sink->end(request);
+          }
+        }
+
+        // Returns the length of the body.  If queryParams is non-null, successful JSON bodies
+        // are limited to the fields it selects.
+        size_t sendResponse(
+          AsyncWebServerRequest* request,
+          RichHttp::Response& response,
+          QueryParams* queryParams = nullptr
+        ) {
+          AsyncWebServerResponse* asyncResponse = nullptr;
+          size_t length = 0;
+          bool hasBody = true;
+          bool isJson = false;
+
+          // Responses to HEAD requests get the headers the body would have been sent with
+          bool headOnly = request->method() == HTTP_HEAD;
+
+          if (response.isSetStream()) {
+            std::shared_ptr<BodyWriter> writer = response.getBodyWriter();
+            length = writer->length();
+
+            if (! headOnly) {
+              // Each chunk is rendered by the writer as it's sent, so nothing is buffered
+              asyncResponse = request->beginResponse(
+                response.getBodyType(),
+                length,
+                [writer](uint8_t* buffer, size_t maxLength, size_t index) -> size_t {
+                  return writer->read(buffer, maxLength, index);
+                }
+              );
+              asyncResponse->setCode(response.getCode());
+            }
+          } else if (response.isSetBuffer()) {
+            const uint8_t* buffer = response.getBuffer();
+            length = response.getBufferLength();
+
+            if (! headOnly && response.isBufferProgmem()) {
+              asyncResponse = request->beginResponse_P(response.getCode(), response.getBodyType(), buffer, length);
+            } else if (! headOnly) {
+              asyncResponse = request->beginResponse(
+                response.getBodyType(),
+                length,
+                [buffer, length](uint8_t* dest, size_t maxLength, size_t index) -> size_t {
+                  size_t chunk = std::min(maxLength, length - index);
+                  memcpy(dest, buffer + index, chunk);
+                  return chunk;
+                }
+              );
+              asyncResponse->setCode(response.getCode());
+            }
+          } else if (response.isSetBody()) {
+            length = response.getBody().length();
+
+            if (! headOnly) {
+              asyncResponse = request->beginResponse(response.getCode(), response.getBodyType(), response.getBody());
+            }
           } else if (! response.json.isNull()) {
-            String body;
-            serializeJson(response.json, body);
-            request->send(response.getCode(), ::RichHttp::CONTENT_TYPE_JSON, body);
+            FieldSelection selection(response.json.as<JsonVariantConst>());
+            // Errors are sent whole, since they wouldn't have the fields asked for
+            bool selected = queryParams != nullptr
+              && response.getCode() >= 200
+              && response.getCode() < 300
+              && selection.select(queryParams->get(RICH_HTTP_FIELDS_PARAM));
+            isJson = true;
+
+            if (headOnly) {
+              length = selected ? selection.length() : measureJson(response.json);
+            } else {
+              String body;
+
+              if (selected) {
+                StringPrint dest(body);
+                selection.writeTo(dest);
+              } else {
+                serializeJson(response.json, body);
+              }
+
+              length = body.length();
+              asyncResponse = request->beginResponse(response.getCode(), ::RichHttp::CONTENT_TYPE_JSON, body);
+            }
+          } else {
+            hasBody = false;
+
+            if (response.isSetCode()) {
+              asyncResponse = request->beginResponse(response.getCode(), FPSTR(::RichHttp::CONTENT_TYPE_TEXT), String());
+            }
           }
+
+          if (headOnly && hasBody) {
+            asyncResponse = new AsyncHeadResponse(
+              response.getCode(),
+              isJson ? String(FPSTR(::RichHttp::CONTENT_TYPE_JSON)) : response.getBodyType(),
+              length
+            );
+          }
+
+          if (asyncResponse != nullptr) {
+            for (const std::pair<String, String>& header : response.getHeaders()) {
+              asyncResponse->addHeader(header.first, header.second);
+            }
+
+            if (this->isCorsEnabled()) {
+              asyncResponse->addHeader(F("Access-Control-Allow-Origin"), this->cors->getAllowOrigin());
+            }
+
+            request->send(asyncResponse);
+          }
+
+          return length;
+        }
+
+        // True if authentication is disabled or the request has valid credentials
+        bool isAuthenticated(AsyncWebServerRequest* request) {
+          return !this->authProvider->isAuthenticationEnabled()
+            || request->authenticate(this->authProvider->getUsername().c_str(), this->authProvider->getPassword().c_str());
+        }
+
+        // Returns true if the request may proceed.  Otherwise an authentication challenge is
+        // sent, and logged against routeId.
+        bool authenticate(AsyncWebServerRequest* request, uint16_t routeId = AccessLog::NO_ROUTE) {
+          if (isAuthenticated(request)) {
+            return true;
+          }
+
+          request->requestAuthentication();
+          logResponse(request, 401, routeId);
+          return false;
+        }
+
+        // Returns true if the client is within rateLimiter's limit, or if rateLimiter is null.
+        // Otherwise responds with 429, which is logged against routeId.
+        bool checkRateLimit(AsyncWebServerRequest* request, RateLimiter* rateLimiter, uint16_t routeId = AccessLog::NO_ROUTE) {
+          uint16_t retryAfter;
+
+          if (rateLimiter == nullptr || rateLimiter->allow(request->client()->remoteIP(), retryAfter)) {
+            return true;
+          }
+
+          AsyncWebServerResponse* response = request->beginResponse(429);
+          response->addHeader(F("Retry-After"), String(retryAfter));
+          request->send(response);
+          logResponse(request, 429, routeId);
+          return false;
+        }
+
+        // Records a response to request sent without running a route's handler
+        void logResponse(AsyncWebServerRequest* request, uint16_t status, uint16_t routeId = AccessLog::NO_ROUTE) {
+          ++this->responseCount;
+
+          if (this->accessLog != nullptr) {
+            this->recordResponse(request->client()->remoteIP(), methodBit(request->method()), status, routeId);
+          }
+        }
+
+        // Answers requests which no handler claimed with fn, or with a 404 if fn is empty.
+        // They're logged as 404s either way.
+        void setNotFoundFn(not_found_fn_type fn) {
+          notFoundFn = fn;
+
+          this->server->onNotFound([this](AsyncWebServerRequest* request) {
+            if (notFoundFn) {
+              notFoundFn(request);
+            } else {
+              request->send(404);
+            }
+
+            logResponse(request, 404);
+          });
         }
 
         template <class RetType, class... Args>
@@ -190,17 +598,23 @@ namespace RichHttp {
           std::function<RetType(AsyncWebServerRequest*, Args...)> fn
         ) {
           return [this, fn](AsyncWebServerRequest* request, Args... args) {
-            if (!this->authProvider->isAuthenticationEnabled()
-              || request->authenticate(this->authProvider->getUsername().c_str(), this->authProvider->getPassword().c_str())) {
+            if (this->authenticate(request)) {
               return fn(request, args...);
-            } else {
-              return request->requestAuthentication();
             }
           };
         }
+
+      private:
+        not_found_fn_type notFoundFn;
     };
 
     class AsyncRequestHandler;
+    class AsyncRouteTableHandler;
+    class AsyncAdmissionHandler;
+    class AsyncPreflightHandler;
+
+    template <class Fn, class UploadFn>
+    class AsyncCompiledRequestHandler;
 
     namespace Configs {
       struct AsyncWebServer : Generics::HandlerConfig<
@@ -223,6 +637,23 @@ namespace RichHttp {
 
         static const _fn_type OtaHandlerFn;
         static const _fn_type OtaSuccessHandlerFn;
+
+        static const _fn_type DeltaOtaHandlerFn;
+        static const _fn_type DeltaOtaSuccessHandlerFn;
+
+        // The OTA handlers send their own responses, which only get CORS headers from the
+        // server's policy
+        template <class Fn>
+        static Fn otaFn(Fn fn, const CorsPolicy&) {
+          return fn;
+        }
+
+        using RouteTableHandlerType = AsyncRouteTableHandler;
+        using AdmissionHandlerType = AsyncAdmissionHandler;
+        using PreflightHandlerType = AsyncPreflightHandler;
+
+        template <class Fn, class UploadFn>
+        using CompiledRequestHandlerType = AsyncCompiledRequestHandler<Fn, UploadFn>;
       };
     };
 
@@ -284,31 +715,391 @@ namespace RichHttp {
         }
     };
 
-    class AsyncRequestContext : public RequestContext {
+    /**
+     * Registered in front of all routes.  Tracks admitted requests until they disconnect, and
+     * claims requests which AdmissionControl rejects and responds with 503 or 429.
+     */
+    class AsyncAdmissionHandler : public ::AsyncWebHandler {
       public:
-        template <class... Args>
-        AsyncRequestContext(
-          BodyArgs bodyArgs,
-          UploadArgs uploadArgs,
+        AsyncAdmissionHandler(
+          ::AsyncWebServer& server,
+          AdmissionControl& admissionControl,
+          AsyncHandlerFnWrapperBuilder<>& fnWrapperBuilder
+        ) : admissionControl(admissionControl)
+          , fnWrapperBuilder(fnWrapperBuilder)
+          , rejections()
+          , nextRejection(0)
+        { }
+
+        virtual bool canHandle(AsyncWebServerRequest* request) override {
+          if (! admissionControl.isEnabled()) {
+            return false;
+          }
+
+          uint16_t retryAfter;
+          AdmissionResult result = admissionControl.admit(
+            request->url().c_str(),
+            request->url().length(),
+            request->client()->remoteIP(),
+            retryAfter
+          );
+
+          if (result == AdmissionResult::ADMITTED) {
+            // A handler may replace this callback, in which case the request stops counting
+            // once it times out (see AdmissionControl::setInFlightTimeout)
+            uint32_t ticket = admissionControl.acquire();
+            request->onDisconnect([this, ticket]() { admissionControl.release(ticket); });
+            return false;
+          }
+
+          Rejection& rejection = rejections[nextRejection];
+          nextRejection = (nextRejection + 1) % RICH_HTTP_ADMISSION_PENDING_REJECTIONS;
+
+          rejection.request = request;
+          rejection.code = result == AdmissionResult::RATE_LIMITED ? 429 : 503;
+          rejection.retryAfter = retryAfter;
+
+          return true;
+        }
+
+        // Shed requests don't need their body parsed
+        virtual bool isRequestHandlerTrivial() override { return true; }
+
+        virtual void handleRequest(AsyncWebServerRequest* request) override {
+          int code = 503;
+          uint16_t retryAfter = admissionControl.getRetryAfter();
+
+          for (Rejection& rejection : rejections) {
+            if (rejection.request == request) {
+              code = rejection.code;
+              retryAfter = rejection.retryAfter;
+              rejection.request = nullptr;
+            }
+          }
+
+          AsyncWebServerResponse* response = request->beginResponse(code);
+          response->addHeader(F("Retry-After"), String(retryAfter));
+          request->send(response);
+          fnWrapperBuilder.logResponse(request, code);
+        }
+
+      private:
+        // Why each recently rejected request was rejected, until its response is sent
+        struct Rejection {
+          AsyncWebServerRequest* request;
+          uint16_t code;
+          uint16_t retryAfter;
+        };
+
+        AdmissionControl& admissionControl;
+        AsyncHandlerFnWrapperBuilder<>& fnWrapperBuilder;
+        Rejection rejections[RICH_HTTP_ADMISSION_PENDING_REJECTIONS];
+        size_t nextRejection;
+    };
+
+    /**
+     * Registered in front of all routes.  Answers OPTIONS requests for paths with routes
+     * from the methods registered for them, unless an OPTIONS route was registered.
+     */
+    class AsyncPreflightHandler : public ::AsyncWebHandler {
+      public:
+        AsyncPreflightHandler(
+          const RouteMethods& routeMethods,
+          const CorsPolicy& cors,
+          AsyncHandlerFnWrapperBuilder<>& fnWrapperBuilder
+        ) : routeMethods(routeMethods)
+          , cors(cors)
+          , fnWrapperBuilder(fnWrapperBuilder)
+          , lastRequest(nullptr)
+          , lastMethods(0)
+        { }
+
+        virtual bool canHandle(AsyncWebServerRequest* request) override {
+          if (request->method() != HTTP_OPTIONS) {
+            return false;
+          }
+
+          lastRequest = request;
+          lastMethods = routeMethods.methodsFor(request->url().c_str(), request->url().length());
+          return lastMethods != 0 && (lastMethods & MethodBits::OPTIONS) == 0;
+        }
+
+        // Preflight requests don't have a body
+        virtual bool isRequestHandlerTrivial() override { return true; }
+
+        virtual void handleRequest(AsyncWebServerRequest* request) override {
+          // Requests on other connections may have been checked in between
+          uint8_t methods = request == lastRequest
+            ? lastMethods
+            : routeMethods.methodsFor(request->url().c_str(), request->url().length());
+          String allow = RouteMethods::allowHeader(methods);
+          AsyncWebServerResponse* response = request->beginResponse(204);
+
+          cors.preflightHeaders(allow, [response](const String& name, const String& value) {
+            response->addHeader(name, value);
+          });
+          request->send(response);
+          fnWrapperBuilder.logResponse(request, 204);
+        }
+
+      private:
+        const RouteMethods& routeMethods;
+        const CorsPolicy& cors;
+        AsyncHandlerFnWrapperBuilder<>& fnWrapperBuilder;
+        // Methods found by the last call to canHandle(), to avoid matching the request twice
+        const AsyncWebServerRequest* lastRequest;
+        uint8_t lastMethods;
+    };
+
+    /**
+     * Serves every route in a route table from a single handler.  The table can be swapped
+     * at runtime (see SwappableRoutes.h).
+     */
+    class AsyncRouteTableHandler : public ::AsyncWebHandler {
+      public:
+        using Generation = SwappableRoutes<Configs::AsyncWebServer>::Generation;
+
+        AsyncRouteTableHandler(
+          AsyncHandlerFnWrapperBuilder<>& fnWrapperBuilder,
+          uint16_t& nextRouteId
+        ) : owned(new SwappableRoutes<Configs::AsyncWebServer>(nextRouteId))
+          , routes(*owned)
+          , fnWrapperBuilder(fnWrapperBuilder)
+        { }
+
+        // Serves a table shared with other servers
+        AsyncRouteTableHandler(
+          AsyncHandlerFnWrapperBuilder<>& fnWrapperBuilder,
+          SwappableRoutes<Configs::AsyncWebServer>& routes
+        ) : routes(routes)
+          , fnWrapperBuilder(fnWrapperBuilder)
+        { }
+
+        virtual bool canHandle(AsyncWebServerRequest* request) override {
+          SwappableRoutes<Configs::AsyncWebServer>::Pin pin(routes);
+          Route<Configs::AsyncWebServer> route;
+
+          if (pin.get() == nullptr || find(*pin.get(), request, route) < 0) {
+            return false;
+          }
+
+          fnWrapperBuilder.filterHeaders(request);
+          return true;
+        }
+
+        virtual bool isRequestHandlerTrivial() override { return false; }
+
+        virtual void handleRequest(AsyncWebServerRequest* request) override {
+          // Will already have been called if there's non-zero content length
+          if (request->contentLength() == 0) {
+            handle(request, BodyArgs{ .data = nullptr, .length = 0, .index = 0, .total = 0 });
+          }
+        }
+
+        virtual void handleBody(
+          AsyncWebServerRequest *request,
+          uint8_t *data,
+          size_t len,
+          size_t index,
+          size_t total
+        ) override {
+          handle(request, BodyArgs{ .data = data, .length = len, .index = index, .total = total });
+        }
+
+        SwappableRoutes<Configs::AsyncWebServer>& getRoutes() {
+          return routes;
+        }
+
+      private:
+        std::unique_ptr<SwappableRoutes<Configs::AsyncWebServer>> owned;
+        SwappableRoutes<Configs::AsyncWebServer>& routes;
+        AsyncHandlerFnWrapperBuilder<>& fnWrapperBuilder;
+
+        int find(
+          const Generation& generation,
           AsyncWebServerRequest* request,
-          Response& response,
-          Args... args
-        ) : RequestContext(response, args...)
-          , body(bodyArgs)
-          , upload(uploadArgs)
-          , rawRequest(request)
+          Route<Configs::AsyncWebServer>& route,
+          PathValues* values = nullptr
+        ) {
+          const String& url = request->url();
+
+          if (request->method() == HTTP_HEAD) {
+            return generation.table.findHead(HTTP_ANY, HTTP_HEAD, HTTP_GET, url.c_str(), url.length(), route, values);
+          }
+
+          return generation.table.find(HTTP_ANY, request->method(), url.c_str(), url.length(), route, values);
+        }
+
+        void handle(AsyncWebServerRequest* request, const BodyArgs& body) {
+          SwappableRoutes<Configs::AsyncWebServer>::Pin pin(routes);
+          const Generation* generation = pin.get();
+          Route<Configs::AsyncWebServer> route;
+          PathValues values;
+          int index = generation != nullptr ? find(*generation, request, route, &values) : -1;
+
+          // The route was removed by a swap after this handler claimed the request
+          if (index < 0) {
+            request->send(404);
+            fnWrapperBuilder.logResponse(request, 404);
+            return;
+          }
+
+          uint16_t routeId = generation->firstRouteId + index;
+
+          // Body chunks after the first belong to a request which has already been counted
+          if (body.index == 0 && ! fnWrapperBuilder.checkRateLimit(request, route.rateLimiter, routeId)) {
+            return;
+          }
+
+          if (! route.disableAuth && ! fnWrapperBuilder.authenticate(request, routeId)) {
+            return;
+          }
+
+          UrlTokenBindings bindings(Routes::patternTokens(route.path, route.numVariables), request->url().c_str());
+
+          fnWrapperBuilder.handleContextFn(
+            route.handler,
+            request,
+            bindings,
+            values,
+            body,
+            body.hasBody(),
+            generation->table.statsFor(index),
+            routeId
+          );
+        }
+    };
+
+    /**
+     * Handler for a single route which stores the user's functions by type, so that a request
+     * goes through one virtual call instead of a stack of std::function wrappers.
+     */
+    template <class Fn, class UploadFn>
+    class AsyncCompiledRequestHandler : public BasePathHandler<Configs::AsyncWebServer, ::AsyncWebHandler> {
+      public:
+        AsyncCompiledRequestHandler(
+          AsyncHandlerFnWrapperBuilder<>& fnWrapperBuilder,
+          WebRequestMethodComposite method,
+          const char* path,
+          Fn fn,
+          UploadFn uploadFn,
+          bool disableAuth,
+          RateLimiter* rateLimiter,
+          RouteHeapStats* stats,
+          uint16_t routeId,
+          size_t pathId
+        ) : BasePathHandler<Configs::AsyncWebServer, ::AsyncWebHandler>(HTTP_ANY, method, path)
+          , fn(fn)
+          , uploadFn(uploadFn)
+          , fnWrapperBuilder(fnWrapperBuilder)
+          , disableAuth(disableAuth)
+          , disableBody(! UploadFnTraits<UploadFn>::hasUpload || method == HTTP_GET)
+          , rateLimiter(rateLimiter)
+          , stats(stats)
+          , routeId(routeId)
+          , pathId(pathId)
         { }
 
-        virtual std::pair<const char*, size_t> loadBody() override {
-          return std::make_pair(reinterpret_cast<const char*>(body.data), body.length);
+        virtual bool canHandle(AsyncWebServerRequest* request) override {
+          if (! matches(request)) {
+            return false;
+          }
+
+          fnWrapperBuilder.filterHeaders(request);
+          return true;
         }
 
-        const BodyArgs body;
-        const UploadArgs upload;
-        AsyncWebServerRequest* rawRequest;
+        virtual bool isRequestHandlerTrivial() override { return false; }
+
+        virtual void handleRequest(AsyncWebServerRequest* request) override {
+          // Will already have been called if there's non-zero content length
+          if (UploadFnTraits<UploadFn>::hasUpload || request->contentLength() == 0) {
+            handle(request, BodyArgs{ .data = nullptr, .length = 0, .index = 0, .total = 0 });
+          }
+        }
+
+        virtual void handleUpload(
+          AsyncWebServerRequest *request,
+          const String& filename,
+          size_t index,
+          uint8_t *data,
+          size_t len,
+          bool isFinal
+        ) override {
+          PathValues values;
+
+          // Unauthenticated uploads are dropped.  The challenge is sent by handleRequest() once
+          // the request is complete.
+          if (UploadFnTraits<UploadFn>::hasUpload
+            && matches(request, &values)
+            && (disableAuth || fnWrapperBuilder.isAuthenticated(request)))
+          {
+            UrlTokenBindings bindings(this->patternTokens, request->url().c_str());
+
+            fnWrapperBuilder.handleUploadContextFn(
+              uploadFn,
+              request,
+              bindings,
+              values,
+              UploadArgs{
+                .filename = filename,
+                .index = index,
+                .data = data,
+                .length = len,
+                .isFinal = isFinal
+              },
+              stats
+            );
+          }
+        }
+
+        virtual void handleBody(
+          AsyncWebServerRequest *request,
+          uint8_t *data,
+          size_t len,
+          size_t index,
+          size_t total
+        ) override {
+          handle(request, BodyArgs{ .data = data, .length = len, .index = index, .total = total });
+        }
 
       private:
-        String loadedBody;
+        Fn fn;
+        UploadFn uploadFn;
+        AsyncHandlerFnWrapperBuilder<>& fnWrapperBuilder;
+        bool disableAuth;
+        bool disableBody;
+        RateLimiter* rateLimiter;
+        RouteHeapStats* stats;
+        uint16_t routeId;
+        // Id of the route's path in the server's RouteMethods
+        size_t pathId;
+
+        void handle(AsyncWebServerRequest* request, const BodyArgs& body) {
+          // Body chunks after the first belong to a request which has already been counted
+          if (body.index == 0 && ! fnWrapperBuilder.checkRateLimit(request, rateLimiter, routeId)) {
+            return;
+          }
+
+          PathValues values;
+
+          if (matches(request, &values) && (disableAuth || fnWrapperBuilder.authenticate(request, routeId))) {
+            UrlTokenBindings bindings(this->patternTokens, request->url().c_str());
+            bool hasBody = !disableBody && body.length > 0;
+
+            fnWrapperBuilder.handleContextFn(fn, request, bindings, values, body, hasBody, stats, routeId);
+          }
+        }
+
+        bool matches(AsyncWebServerRequest* request, PathValues* values = nullptr) {
+          WebRequestMethodComposite method = request->method();
+
+          if (method == HTTP_HEAD && this->method == HTTP_GET && fnWrapperBuilder.servesHeadAsGet(pathId)) {
+            method = HTTP_GET;
+          }
+
+          return this->_canHandle(method, request->url().c_str(), request->url().length(), values);
+        }
     };
   };
 };
@@ -19,6 +19,16 @@ namespace RichHttp {
 
         static const _fn_type OtaHandlerFn;
         static const _fn_type OtaSuccessHandlerFn;
+
+        static const _fn_type DeltaOtaHandlerFn;
+        static const _fn_type DeltaOtaSuccessHandlerFn;
+
+        using RouteTableHandlerType = EspressifRouteTableHandler<ESP32Config, String>;
+        using AdmissionHandlerType = EspressifAdmissionHandler<ESP32Config, String>;
+        using PreflightHandlerType = EspressifPreflightHandler<ESP32Config, String>;
+
+        template <class Fn, class UploadFn>
+        using CompiledRequestHandlerType = EspressifCompiledRequestHandler<ESP32Config, String, Fn, UploadFn>;
       };
       using EspressifBuiltin = ESP32Config;
     };
@@ -21,6 +21,16 @@ namespace RichHttp {
 
         static const _fn_type OtaHandlerFn;
         static const _fn_type OtaSuccessHandlerFn;
+
+        static const _fn_type DeltaOtaHandlerFn;
+        static const _fn_type DeltaOtaSuccessHandlerFn;
+
+        using RouteTableHandlerType = EspressifRouteTableHandler<ESP8266Config, const String&>;
+        using AdmissionHandlerType = EspressifAdmissionHandler<ESP8266Config, const String&>;
+        using PreflightHandlerType = EspressifPreflightHandler<ESP8266Config, const String&>;
+
+        template <class Fn, class UploadFn>
+        using CompiledRequestHandlerType = EspressifCompiledRequestHandler<ESP8266Config, const String&, Fn, UploadFn>;
       };
       using EspressifBuiltin = ESP8266Config;
     };
@@ -1,5 +1,6 @@
 #include "PlatformESP8266.h"
 #include "PlatformESP32.h"
+#include "../DeltaUpdate.h"
 
 #if (defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)) && !defined(RICH_HTTP_ASYNC_WEBSERVER)
 
@@ -55,8 +56,7 @@ const __fn_type _Config::OtaHandlerFn = [](__context_type context) {
 };
 
 const __fn_type _Config::OtaSuccessHandlerFn = [](__context_type context) {
-  context.server.sendHeader("Connection", "close");
-  context.server.sendHeader("Access-Control-Allow-Origin", "*");
+  RichHttp::Generics::closeConnection(context.server);
 
   if (Update.hasError()) {
     context.response.json["success"] = false;
@@ -70,4 +70,49 @@ const __fn_type _Config::OtaSuccessHandlerFn = [](__context_type context) {
   ESP.restart();
 };
 
+const __fn_type _Config::DeltaOtaHandlerFn = [](__context_type context) {
+  HTTPUpload& upload = context.server.upload();
+
+  if (upload.status == UPLOAD_FILE_START) {
+#if defined(ESP8266)
+    WiFiUDP::stopAll();
+#endif
+    RichHttp::Delta::beginUpdate();
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (! RichHttp::Delta::hasUpdateError() && ! RichHttp::Delta::writeUpdate(upload.buf, upload.currentSize)) {
+      RichHttp::Delta::printUpdateError(Serial);
+      RichHttp::Delta::endUpdate();
+      context.response.setCode(500);
+      return;
+    }
+  } else if (upload.status == UPLOAD_FILE_END) {
+    if (! RichHttp::Delta::endUpdate()) {
+      RichHttp::Delta::printUpdateError(Serial);
+      context.response.setCode(500);
+    }
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    RichHttp::Delta::endUpdate();
+  }
+  yield();
+};
+
+const __fn_type _Config::DeltaOtaSuccessHandlerFn = [](__context_type context) {
+  RichHttp::Generics::closeConnection(context.server);
+
+  if (RichHttp::Delta::hasUpdateError()) {
+    context.response.json["success"] = false;
+    context.response.json["error"] = RichHttp::Delta::errorToString(RichHttp::Delta::getUpdateError());
+    context.response.setCode(500);
+
+    // The running sketch is untouched, so there's no reason to restart.
+    return;
+  }
+
+  context.server.send(200, "text/plain", "Update successful");
+
+  delay(1000);
+
+  ESP.restart();
+};
+
 #endif
\ No newline at end of file
@@ -4,6 +4,10 @@
 #include <ArduinoJson.h>
 #include "Generics.h"
 #include "../RichResponse.h"
+#include "../RouteTable.h"
+#include "../SwappableRoutes.h"
+#include "../AdmissionControl.h"
+#include "../KeepAlive.h"
 
 #include <functional>
 
@@ -15,11 +19,46 @@
 #include <WebServer.h>
 #endif
 
+// ESP8266WebServer keeps connections open from core 3.0.  Other builtin servers always close
+// them after the response.
+#if defined(ARDUINO_ARCH_ESP8266) && __has_include(<core_version.h>)
+#include <core_version.h>
+#if defined(ARDUINO_ESP8266_MAJOR) && ARDUINO_ESP8266_MAJOR >= 3
+#define RICH_HTTP_SERVER_KEEP_ALIVE
+#endif
+#endif
+
 namespace RichHttp {
   namespace Generics {
     template <class TServer>
     class EspressifRequestContext;
 
+    // Closes the connection once the current response has been sent
+    template <class TServer>
+    void closeConnection(TServer& server) {
+#if defined(RICH_HTTP_SERVER_KEEP_ALIVE)
+      server.keepAlive(false);
+#endif
+    }
+
+    /**
+     * Wraps an OTA route's handler so pages on any origin can upload firmware, as they could
+     * before CorsPolicy, unless CORS has been configured.
+     */
+    template <class Fn>
+    struct AnyOriginFn {
+      Fn fn;
+      const CorsPolicy* cors;
+
+      template <class TServer>
+      void operator()(EspressifRequestContext<TServer>& context) const {
+        if (! cors->isEnabled()) {
+          context.server.sendHeader(F("Access-Control-Allow-Origin"), F("*"));
+        }
+        fn(context);
+      }
+    };
+
     namespace BuiltinFns {
       using handler_type = FunctionWrapper<void, const UrlTokenBindings*>;
 
@@ -62,7 +101,12 @@ namespace RichHttp {
         TRequestHandlerClass,
         ::RichHttp::Generics::EspressifHandlerFnWrapperBuilder<TServerType>,
         EspressifRequestContext<TServerType>
-      > { };
+      > {
+        template <class Fn>
+        static AnyOriginFn<Fn> otaFn(Fn fn, const CorsPolicy& cors) {
+          return AnyOriginFn<Fn>{ .fn = fn, .cors = &cors };
+        }
+      };
     };
 
     template <class TConfig, class StringType>
@@ -107,6 +151,288 @@ namespace RichHttp {
         }
     };
 
+    /**
+     * Registered in front of all routes.  Claims requests which AdmissionControl rejects and
+     * responds with 503 or 429.  Since it sees every request first, it also starts each
+     * request for the keep-alive policy.
+     */
+    template <class TConfig, class StringType>
+    class EspressifAdmissionHandler : public ::RequestHandler {
+      public:
+        EspressifAdmissionHandler(
+          typename TConfig::ServerType& server,
+          AdmissionControl& admissionControl,
+          typename TConfig::FnWrapperBuilderType& fnWrapperBuilder
+        ) : server(server)
+          , admissionControl(admissionControl)
+          , fnWrapperBuilder(fnWrapperBuilder)
+          , rejection(AdmissionResult::ADMITTED)
+          , retryAfter(0)
+        { }
+
+        // The server looks up a request's handler once, so every call is for a new request.
+        // The decision is replaced here rather than cleared in handle(), which the server
+        // skips if it drops the request.
+        virtual bool canHandle(typename TConfig::HttpMethod method, StringType uri) override {
+          fnWrapperBuilder.beginRequest();
+          rejection = AdmissionResult::ADMITTED;
+
+          if (! admissionControl.isEnabled()) {
+            return false;
+          }
+
+          rejection = admissionControl.admit(uri.c_str(), uri.length(), server.client().remoteIP(), retryAfter);
+          return rejection != AdmissionResult::ADMITTED;
+        }
+
+        virtual bool handle(typename TConfig::ServerType& server, typename TConfig::HttpMethod method, StringType uri) override {
+          server.sendHeader(F("Retry-After"), String(retryAfter));
+
+          if (rejection == AdmissionResult::RATE_LIMITED) {
+            server.send_P(429, ::RichHttp::CONTENT_TYPE_TEXT, PSTR("Too Many Requests"));
+            fnWrapperBuilder.logResponse(429);
+          } else {
+            server.send_P(503, ::RichHttp::CONTENT_TYPE_TEXT, PSTR("Service Unavailable"));
+            fnWrapperBuilder.logResponse(503);
+          }
+
+          return true;
+        }
+
+      private:
+        typename TConfig::ServerType& server;
+        AdmissionControl& admissionControl;
+        typename TConfig::FnWrapperBuilderType& fnWrapperBuilder;
+        AdmissionResult rejection;
+        uint16_t retryAfter;
+    };
+
+    /**
+     * Registered in front of all routes.  Answers OPTIONS requests for paths with routes
+     * from the methods registered for them, unless an OPTIONS route was registered.
+     */
+    template <class TConfig, class StringType>
+    class EspressifPreflightHandler : public ::RequestHandler {
+      public:
+        EspressifPreflightHandler(
+          const RouteMethods& routeMethods,
+          const CorsPolicy& cors,
+          typename TConfig::FnWrapperBuilderType& fnWrapperBuilder
+        ) : routeMethods(routeMethods)
+          , cors(cors)
+          , fnWrapperBuilder(fnWrapperBuilder)
+          , methods(0)
+        { }
+
+        // The server looks up a request's handler once, so the methods found here are for the
+        // request handle() is called with
+        virtual bool canHandle(typename TConfig::HttpMethod method, StringType uri) override {
+          if (method != HTTP_OPTIONS) {
+            return false;
+          }
+
+          methods = routeMethods.methodsFor(uri.c_str(), uri.length());
+          return methods != 0 && (methods & MethodBits::OPTIONS) == 0;
+        }
+
+        virtual bool handle(typename TConfig::ServerType& server, typename TConfig::HttpMethod method, StringType uri) override {
+          String allow = RouteMethods::allowHeader(methods);
+
+          cors.preflightHeaders(allow, [&server](const String& name, const String& value) {
+            server.sendHeader(name, value);
+          });
+          server.send_P(204, ::RichHttp::CONTENT_TYPE_TEXT, PSTR(""));
+          fnWrapperBuilder.logResponse(204);
+
+          return true;
+        }
+
+      private:
+        const RouteMethods& routeMethods;
+        const CorsPolicy& cors;
+        typename TConfig::FnWrapperBuilderType& fnWrapperBuilder;
+        uint8_t methods;
+    };
+
+    /**
+     * Serves every route in a route table from a single handler.  The table can be swapped
+     * at runtime (see SwappableRoutes.h).
+     */
+    template <class TConfig, class StringType>
+    class EspressifRouteTableHandler : public ::RequestHandler {
+      public:
+        EspressifRouteTableHandler(
+          typename TConfig::FnWrapperBuilderType& fnWrapperBuilder,
+          uint16_t& nextRouteId
+        ) : owned(new SwappableRoutes<TConfig>(nextRouteId))
+          , routes(*owned)
+          , fnWrapperBuilder(fnWrapperBuilder)
+        { }
+
+        // Serves a table shared with other servers
+        EspressifRouteTableHandler(
+          typename TConfig::FnWrapperBuilderType& fnWrapperBuilder,
+          SwappableRoutes<TConfig>& routes
+        ) : routes(routes)
+          , fnWrapperBuilder(fnWrapperBuilder)
+        { }
+
+        virtual bool canHandle(typename TConfig::HttpMethod method, StringType uri) override {
+          typename SwappableRoutes<TConfig>::Pin pin(routes);
+          Route<TConfig> route;
+
+          return pin.get() != nullptr && find(*pin.get(), method, uri, route) >= 0;
+        }
+
+        virtual bool handle(typename TConfig::ServerType& server, typename TConfig::HttpMethod method, StringType uri) override {
+          // Keeps the table alive if the handler swaps it
+          typename SwappableRoutes<TConfig>::Pin pin(routes);
+          const typename SwappableRoutes<TConfig>::Generation* generation = pin.get();
+          Route<TConfig> route;
+          PathValues values;
+          int index = generation != nullptr ? find(*generation, method, uri, route, &values) : -1;
+
+          if (index < 0) {
+            return false;
+          }
+
+          uint16_t routeId = generation->firstRouteId + index;
+
+          if (! fnWrapperBuilder.checkRateLimit(route.rateLimiter, routeId)
+            || (! route.disableAuth && ! fnWrapperBuilder.authenticate(routeId)))
+          {
+            return true;
+          }
+
+          UrlTokenBindings bindings(Routes::patternTokens(route.path, route.numVariables), uri.c_str());
+          bool hasBody = method != HTTP_GET && server.hasArg("plain");
+
+          fnWrapperBuilder.handleContextFn(
+            route.handler,
+            bindings,
+            values,
+            hasBody,
+            generation->table.statsFor(index),
+            routeId
+          );
+
+          return true;
+        }
+
+        SwappableRoutes<TConfig>& getRoutes() {
+          return routes;
+        }
+
+      private:
+        std::unique_ptr<SwappableRoutes<TConfig>> owned;
+        SwappableRoutes<TConfig>& routes;
+        typename TConfig::FnWrapperBuilderType& fnWrapperBuilder;
+
+        int find(
+          const typename SwappableRoutes<TConfig>::Generation& generation,
+          typename TConfig::HttpMethod method,
+          StringType uri,
+          Route<TConfig>& route,
+          PathValues* values = nullptr
+        ) {
+          if (method == HTTP_HEAD) {
+            return generation.table.findHead(HTTP_ANY, HTTP_HEAD, HTTP_GET, uri.c_str(), uri.length(), route, values);
+          }
+
+          return generation.table.find(HTTP_ANY, method, uri.c_str(), uri.length(), route, values);
+        }
+    };
+
+    /**
+     * Handler for a single route which stores the user's functions by type, so that a request
+     * goes through one virtual call instead of a stack of std::function wrappers.
+     */
+    template <class TConfig, class StringType, class Fn, class UploadFn>
+    class EspressifCompiledRequestHandler : public BasePathHandler<TConfig, ::RequestHandler> {
+      public:
+        EspressifCompiledRequestHandler(
+          typename TConfig::FnWrapperBuilderType& fnWrapperBuilder,
+          typename TConfig::HttpMethod method,
+          const char* path,
+          Fn fn,
+          UploadFn uploadFn,
+          bool disableAuth,
+          RateLimiter* rateLimiter,
+          RouteHeapStats* stats,
+          uint16_t routeId,
+          size_t pathId
+        ) : BasePathHandler<TConfig, ::RequestHandler>(HTTP_ANY, method, path)
+          , fn(fn)
+          , uploadFn(uploadFn)
+          , fnWrapperBuilder(fnWrapperBuilder)
+          , disableAuth(disableAuth)
+          , disableBody(! UploadFnTraits<UploadFn>::hasUpload || method == HTTP_GET)
+          , rateLimiter(rateLimiter)
+          , stats(stats)
+          , routeId(routeId)
+          , pathId(pathId)
+        { }
+
+        virtual bool canHandle(typename TConfig::HttpMethod method, StringType uri) override {
+          return matches(method, uri);
+        }
+
+        virtual bool canUpload(StringType uri) override {
+          return UploadFnTraits<UploadFn>::hasUpload && this->_canHandle(HTTP_POST, uri.c_str(), uri.length());
+        }
+
+        virtual bool handle(typename TConfig::ServerType& server, typename TConfig::HttpMethod method, StringType uri) override {
+          PathValues values;
+
+          if (! matches(method, uri, &values)) {
+            return false;
+          }
+
+          if (fnWrapperBuilder.checkRateLimit(rateLimiter, routeId) && (this->disableAuth || fnWrapperBuilder.authenticate(routeId))) {
+            UrlTokenBindings bindings(this->patternTokens, uri.c_str());
+            bool hasBody = !disableBody && server.hasArg("plain");
+
+            fnWrapperBuilder.handleContextFn(fn, bindings, values, hasBody, stats, routeId);
+          }
+
+          return true;
+        }
+
+        virtual void upload(typename TConfig::ServerType& server, StringType uri, HTTPUpload& upload) override {
+          PathValues values;
+
+          // Unauthenticated uploads are dropped.  The challenge is sent by handle() once the
+          // request is complete.
+          if (UploadFnTraits<UploadFn>::hasUpload
+            && this->canHandlePath(uri.c_str(), uri.length(), &values)
+            && (this->disableAuth || fnWrapperBuilder.isAuthenticated()))
+          {
+            UrlTokenBindings bindings(this->patternTokens, uri.c_str());
+            fnWrapperBuilder.handleUploadContextFn(uploadFn, bindings, values, stats);
+          }
+        }
+
+      private:
+        Fn fn;
+        UploadFn uploadFn;
+        typename TConfig::FnWrapperBuilderType& fnWrapperBuilder;
+        bool disableAuth;
+        bool disableBody;
+        RateLimiter* rateLimiter;
+        RouteHeapStats* stats;
+        uint16_t routeId;
+        // Id of the route's path in the server's RouteMethods
+        size_t pathId;
+
+        bool matches(typename TConfig::HttpMethod method, StringType uri, PathValues* values = nullptr) {
+          if (method == HTTP_HEAD && this->method == HTTP_GET && fnWrapperBuilder.servesHeadAsGet(pathId)) {
+            method = HTTP_GET;
+          }
+
+          return this->_canHandle(method, uri.c_str(), uri.length(), values);
+        }
+    };
+
     template <
       class TServerType,
       class THandler,
@@ -135,13 +461,16 @@ namespace RichHttp {
               TUploadHandler,
               TContextHandler,
               TUploadContextHandler
-            >(args...) {}
+            >(args...)
+          , keepAlive(nullptr)
+        {}
 
         using fn_type = typename THandler::type;
         using body_fn_type = typename TBodyHandler::type;
         using upload_fn_type = typename TUploadHandler::type;
         using context_fn_type = typename TContextHandler::type;
         using upload_context_fn_type = typename TUploadContextHandler::type;
+        using not_found_fn_type = typename TServerType::THandlerFunction;
 
         virtual fn_type buildAuthedFn(fn_type fn) override {
           return buildAuthedHandler(fn);
@@ -155,77 +484,343 @@ namespace RichHttp {
           return buildAuthedHandler(fn);
         }
 
-        virtual body_fn_type wrapContextFn(context_fn_type fn, bool disableBody) override {
-          return [this, fn, disableBody](const UrlTokenBindings* bindings) {
-            DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
-            Response response(responseDoc);
-
+        virtual body_fn_type wrapContextFn(context_fn_type fn, bool disableBody, RouteHeapStats* stats) override {
+          return [this, fn, disableBody, stats](const UrlTokenBindings* bindings) {
             bool hasBody = !disableBody && this->server->hasArg("plain");
-
-            EspressifRequestContext<TServerType> context(
-              *this->server,
-              response,
-              *bindings,
-              hasBody
-            );
-
-            fn(context);
-
-            sendResponse(response);
+            handleContextFn(fn, *bindings, PathValues(), hasBody, stats, AccessLog::NO_ROUTE);
           };
         }
 
         virtual upload_fn_type wrapUploadContextFn(upload_context_fn_type fn) override {
           return [this, fn](const UrlTokenBindings* bindings) {
-            DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
-            Response response(responseDoc);
+            handleUploadContextFn(fn, *bindings, PathValues(), nullptr);
+          };
+        }
+
+        // Runs a context handler against the current request and sends its response.
+        template <class Fn>
+        void handleContextFn(
+          Fn& fn,
+          const UrlTokenBindings& bindings,
+          const PathValues& values,
+          bool hasBody,
+          RouteHeapStats* stats,
+          uint16_t routeId
+        ) {
+          HeapProbe probe(stats);
+          uint32_t startedAt = this->accessLog != nullptr ? micros() : 0;
+
+          DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
+          Response response(responseDoc);
+
+          EspressifRequestContext<TServerType> context(
+            *this->server,
+            response,
+            bindings,
+            values,
+            hasBody
+          );
+
+          // Sent up front since some handlers (e.g., OTA) respond directly through the server
+          if (this->isCorsEnabled()) {
+            this->server->sendHeader(F("Access-Control-Allow-Origin"), this->cors->getAllowOrigin());
+          }
+          probe.handlerStarted();
+          MiddlewarePipeline::run(this->middleware, fn, context);
+          probe.handlerFinished();
+
+          size_t bytes = sendResponse(response, &context.queryParams);
+          probe.responseSent();
+          ++this->responseCount;
+
+          if (this->accessLog != nullptr) {
+            uint32_t latency = micros() - startedAt;
+
+            this->accessLog->record(AccessLogEntry{
+              .timestamp = static_cast<uint32_t>(millis() - latency / 1000),
+              .client = this->server->client().remoteIP(),
+              .bytes = static_cast<uint32_t>(bytes),
+              .latency = latency,
+              .route = routeId,
+              .status = static_cast<uint16_t>(response.getCode()),
+              .method = methodBit(this->server->method())
+            });
+          }
+        }
 
-            EspressifRequestContext<TServerType> context(
-              *this->server,
-              response,
-              *bindings,
-              false
-            );
+        template <class Fn>
+        void handleUploadContextFn(Fn& fn, const UrlTokenBindings& bindings, const PathValues& values, RouteHeapStats* stats) {
+          UploadHeapProbe probe(stats);
 
-            fn(context);
+          DynamicJsonDocument responseDoc(RICH_HTTP_RESPONSE_BUFFER_SIZE);
+          Response response(responseDoc);
 
+          EspressifRequestContext<TServerType> context(
+            *this->server,
+            response,
+            bindings,
+            values,
+            false
+          );
+
+          fn(context);
+
+          // Runs for every chunk, so a code alone (e.g. from a failed OTA write) is left for the
+          // request's handler to report once the upload is complete
+          if (response.hasContent()) {
             sendResponse(response);
-          };
+          }
+        }
+
+        // Feeds each chunk of the upload to the sink.  The server only receives one upload at a
+        // time, so it identifies the upload's owner.
+        void handleUploadContextFn(UploadSinkFn& fn, const UrlTokenBindings&, const PathValues&, RouteHeapStats* stats) {
+          UploadHeapProbe probe(stats);
+          HTTPUpload& upload = this->server->upload();
+
+          if (upload.status == UPLOAD_FILE_START) {
+            fn.sink->begin(this->server);
+          } else if (upload.status == UPLOAD_FILE_WRITE) {
+            fn.sink->write(this->server, upload.buf, upload.currentSize);
+          } else if (upload.status == UPLOAD_FILE_END) {
+            fn.sink->end(this->server);
+          } else if (upload.status == UPLOAD_FILE_ABORTED) {
+            fn.sink->abort(this->server);
+          }
         }
 
-        void sendResponse(RichHttp::Response& response) {
-          if (response.isSetBody()) {
-            this->server->send(response.getCode(), response.getBodyType(), response.getBody());
+        // Returns the length of the body.  If queryParams is non-null, successful JSON bodies
+        // are limited to the fields it selects.
+        size_t sendResponse(RichHttp::Response& response, QueryParams* queryParams = nullptr) {
+          // The handler responded directly through the server (e.g. OTA).  Headers sent now
+          // would be held by the server for the next response.
+          if (! response.hasContent() && ! response.isSetCode()) {
+            return 0;
+          }
+
+          for (const std::pair<String, String>& header : response.getHeaders()) {
+            this->server->sendHeader(header.first, header.second);
+          }
+
+          // Responses to HEAD requests get the headers the body would have been sent with
+          bool headOnly = this->server->method() == HTTP_HEAD;
+          size_t length = 0;
+
+          if (response.isSetStream()) {
+            const BodyWriter& writer = *response.getBodyWriter();
+            length = writer.length();
+
+            this->server->setContentLength(length);
+            this->server->send(response.getCode(), response.getBodyType(), String());
+
+            if (! headOnly) {
+              WiFiClient dest = this->server->client();
+              writer.writeTo(dest);
+            }
+          } else if (response.isSetBuffer()) {
+            length = response.getBufferLength();
+
+            this->server->setContentLength(length);
+            this->server->send(response.getCode(), response.getBodyType(), String());
+
+            if (! headOnly) {
+              if (response.isBufferProgmem()) {
+                this->server->sendContent_P(reinterpret_cast<PGM_P>(response.getBuffer()), length);
+              } else {
+                this->server->client().write(response.getBuffer(), length);
+              }
+            }
+          } else if (response.isSetBody()) {
+            length = response.getBody().length();
+
+            if (headOnly) {
+              this->server->setContentLength(length);
+              this->server->send(response.getCode(), response.getBodyType(), String());
+            } else {
+              this->server->send(response.getCode(), response.getBodyType(), response.getBody());
+            }
           } else if (! response.json.isNull()) {
-            this->server->setContentLength(measureJson(response.json));
+            FieldSelection selection(response.json.as<JsonVariantConst>());
+            // Errors are sent whole, since they wouldn't have the fields asked for
+            bool selected = queryParams != nullptr
+              && response.getCode() >= 200
+              && response.getCode() < 300
+              && selection.select(queryParams->get(RICH_HTTP_FIELDS_PARAM));
+
+            length = selected ? selection.length() : measureJson(response.json);
+
+            this->server->setContentLength(length);
             this->server->send_P(response.getCode(), ::RichHttp::CONTENT_TYPE_JSON, "");
 
-            WiFiClient dest = this->server->client();
-            serializeJson(response.json, dest);
+            if (! headOnly) {
+              WiFiClient dest = this->server->client();
+
+              if (selected) {
+                selection.writeTo(dest);
+              } else {
+                serializeJson(response.json, dest);
+              }
+            }
+          } else if (response.isSetCode()) {
+            // e.g. a 204.  Sent with a Content-Length of 0 so the connection can be reused.
+            this->server->send_P(response.getCode(), ::RichHttp::CONTENT_TYPE_TEXT, PSTR(""));
+          }
+
+          return length;
+        }
+
+        // The builtin servers only store the headers they're told to collect, along with
+        // Authorization
+        virtual void setCollectedHeaders(HeaderSet* headers) override {
+          this->collectedHeaders = headers;
+          this->server->collectHeaders(headers->getNames(), headers->size());
+        }
+
+        // Requests count towards policy's limits.  Pass null to leave connections to the server.
+        void setKeepAlive(KeepAlivePolicy* policy) {
+          this->keepAlive = policy;
+        }
+
+        // Called as each request arrives, before anything is sent.  If it's the last request
+        // the keep-alive policy allows on the connection, the response says so and the server
+        // closes the connection after sending it.
+        void beginRequest() {
+          if (keepAlive != nullptr) {
+            WiFiClient client = this->server->client();
+
+            if (! keepAlive->onRequest(client.remoteIP(), client.remotePort(), millis())) {
+              closeConnection(*this->server);
+            }
+          }
+        }
+
+        // True if authentication is disabled or the current request has valid credentials
+        bool isAuthenticated() {
+          return ! this->authProvider->isAuthenticationEnabled()
+            || this->server->authenticate(this->authProvider->getUsername().c_str(), this->authProvider->getPassword().c_str());
+        }
+
+        // Returns true if the current request may proceed.  Otherwise an authentication
+        // challenge is sent, and logged against routeId.
+        bool authenticate(uint16_t routeId = AccessLog::NO_ROUTE) {
+          if (isAuthenticated()) {
+            return true;
+          }
+
+          this->server->requestAuthentication();
+          logResponse(401, routeId);
+          return false;
+        }
+
+        // Returns true if the current client is within rateLimiter's limit, or if rateLimiter
+        // is null.  Otherwise responds with 429, which is logged against routeId.
+        bool checkRateLimit(RateLimiter* rateLimiter, uint16_t routeId = AccessLog::NO_ROUTE) {
+          uint16_t retryAfter;
+
+          if (rateLimiter == nullptr || rateLimiter->allow(this->server->client().remoteIP(), retryAfter)) {
+            return true;
+          }
+
+          this->server->sendHeader(F("Retry-After"), String(retryAfter));
+          this->server->send_P(429, ::RichHttp::CONTENT_TYPE_TEXT, PSTR("Too Many Requests"));
+          logResponse(429, routeId);
+          return false;
+        }
+
+        // Records a response to the current request sent without running a route's handler
+        void logResponse(uint16_t status, uint16_t routeId = AccessLog::NO_ROUTE) {
+          ++this->responseCount;
+
+          if (this->accessLog != nullptr) {
+            this->recordResponse(this->server->client().remoteIP(), methodBit(this->server->method()), status, routeId);
           }
         }
 
+        // Answers requests which no handler claimed with fn, or with a 404 if fn is empty.
+        // They're logged as 404s either way.
+        void setNotFoundFn(not_found_fn_type fn) {
+          notFoundFn = fn;
+
+          this->server->onNotFound([this]() {
+            if (notFoundFn) {
+              notFoundFn();
+            } else {
+              this->server->send_P(404, ::RichHttp::CONTENT_TYPE_TEXT, PSTR("Not Found"));
+            }
+
+            logResponse(404);
+          });
+        }
+
         template <class RetType, class... Args>
         std::function<RetType(Args...)> buildAuthedHandler(std::function<RetType(Args...)> fn) {
           return [this, fn](Args... args) {
-            if (this->authProvider->isAuthenticationEnabled()
-              && !this->server->authenticate(this->authProvider->getUsername().c_str(), this->authProvider->getPassword().c_str()))
-            {
-              this->server->requestAuthentication();
-            } else {
+            if (this->authenticate()) {
               return fn(args...);
             }
           };
         }
+
+      private:
+        KeepAlivePolicy* keepAlive;
+        not_found_fn_type notFoundFn;
+    };
+
+    /**
+     * Query parameters parsed by the server.  Also includes form fields.
+     */
+    template <class TServer>
+    class EspressifQueryParams : public QueryParams {
+      public:
+        EspressifQueryParams(TServer& server)
+          : server(server)
+        { }
+
+      protected:
+        virtual void load() override {
+          int numArgs = server.args();
+
+          for (int i = 0; i < numArgs; ++i) {
+#if defined(ARDUINO_ARCH_ESP8266)
+            const String& name = server.argName(i);
+
+            // The body of a request which isn't a form is exposed as "plain"
+            if (name != "plain") {
+              add(name.c_str(), server.arg(i).c_str());
+            }
+#else
+            // WebServer returns copies, so they're kept until the request is finished
+            if (numCopies < RICH_HTTP_MAX_QUERY_PARAMS) {
+              names[numCopies] = server.argName(i);
+              values[numCopies] = server.arg(i);
+
+              if (names[numCopies] != "plain") {
+                add(names[numCopies].c_str(), values[numCopies].c_str());
+                ++numCopies;
+              }
+            }
+#endif
+          }
+        }
+
+      private:
+        TServer& server;
+
+#if !defined(ARDUINO_ARCH_ESP8266)
+        String names[RICH_HTTP_MAX_QUERY_PARAMS];
+        String values[RICH_HTTP_MAX_QUERY_PARAMS];
+        size_t numCopies = 0;
+#endif
     };
 
     template <class TServer>
     class EspressifRequestContext : public RequestContext {
       public:
         template <class... Args>
-        EspressifRequestContext(TServer& server, Response& response, Args... args)
-          : RequestContext(response, args...)
+        EspressifRequestContext(TServer& server, Response& response, Args&&... args)
+          : RequestContext(response, _queryParams, std::forward<Args>(args)...)
           , server(server)
+          , _queryParams(server)
         { }
 
         virtual std::pair<const char*, size_t> loadBody() override {
@@ -233,12 +828,28 @@ namespace RichHttp {
           return std::make_pair(this->_body.c_str(), this->_body.length());
         }
 
+        virtual bool hasHeader(const char* name) override {
+          return this->server.hasHeader(name);
+        }
+
+        virtual String getHeader(const char* name) override {
+          return this->server.header(name);
+        }
+
         TServer& server;
 
       private:
+        EspressifQueryParams<TServer> _queryParams;
+
         // Have to keep a copy of the returned body.
         String _body;
     };
+
+    // Identifies the request's upload to an UploadSink
+    template <class TServer>
+    const void* uploadOwner(EspressifRequestContext<TServer>& context) {
+      return &context.server;
+    }
   };
 };
 #endif
\ No newline at end of file
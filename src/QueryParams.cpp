@@ -0,0 +1,98 @@
+#include "QueryParams.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+namespace RichHttp {
+  QueryParams::QueryParams()
+    : count(0)
+    , loaded(false)
+  { }
+
+  void QueryParams::add(const char* name, const char* value) {
+    if (count < RICH_HTTP_MAX_QUERY_PARAMS) {
+      params[count].name = name;
+      params[count].value = value;
+      ++count;
+    }
+  }
+
+  const char* QueryParams::get(const char* name) {
+    ensureLoaded();
+
+    for (size_t i = 0; i < count; ++i) {
+      if (strcmp(params[i].name, name) == 0) {
+        return params[i].value;
+      }
+    }
+
+    return nullptr;
+  }
+
+  long QueryParams::getInt(const char* name, long defaultValue) {
+    const char* value = get(name);
+
+    if (value == nullptr || *value == 0) {
+      return defaultValue;
+    }
+
+    char* end;
+    long result = strtol(value, &end, 10);
+
+    return *end == 0 ? result : defaultValue;
+  }
+
+  float QueryParams::getFloat(const char* name, float defaultValue) {
+    const char* value = get(name);
+
+    if (value == nullptr || *value == 0) {
+      return defaultValue;
+    }
+
+    char* end;
+    float result = strtof(value, &end);
+
+    return *end == 0 ? result : defaultValue;
+  }
+
+  bool QueryParams::getBool(const char* name, bool defaultValue) {
+    const char* value = get(name);
+
+    if (value == nullptr) {
+      return defaultValue;
+    }
+
+    if (*value == 0
+      || strcasecmp(value, "true") == 0
+      || strcmp(value, "1") == 0
+      || strcasecmp(value, "yes") == 0
+      || strcasecmp(value, "on") == 0) {
+      return true;
+    }
+
+    if (strcasecmp(value, "false") == 0
+      || strcmp(value, "0") == 0
+      || strcasecmp(value, "no") == 0
+      || strcasecmp(value, "off") == 0) {
+      return false;
+    }
+
+    return defaultValue;
+  }
+
+  size_t QueryParams::size() {
+    ensureLoaded();
+    return count;
+  }
+
+  const char* QueryParams::nameAt(size_t index) {
+    ensureLoaded();
+    return index < count ? params[index].name : nullptr;
+  }
+
+  const char* QueryParams::valueAt(size_t index) {
+    ensureLoaded();
+    return index < count ? params[index].value : nullptr;
+  }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <stddef.h>
+
+// Maximum number of query parameters visible through RequestContext::queryParams.  Any past
+// this are ignored.
+#ifndef RICH_HTTP_MAX_QUERY_PARAMS
+#define RICH_HTTP_MAX_QUERY_PARAMS 8
+#endif
+
+namespace RichHttp {
+  /**
+   * Read-only view of a request's query parameters.  The parameters are indexed on first
+   * access by pointing into the backend's already decoded copies, so lookups and the typed
+   * getters don't allocate.  Pointers returned are valid until the request is finished.
+   */
+  class QueryParams {
+    public:
+      QueryParams();
+      virtual ~QueryParams() = default;
+
+      // Value of the named parameter, or null if it's not present.  A parameter without a
+      // value (e.g. "?verbose") has an empty value.
+      const char* get(const char* name);
+
+      inline bool has(const char* name) { return get(name) != nullptr; }
+
+      // Typed getters return defaultValue if the parameter is missing or isn't a valid value
+      // of the type.
+      long getInt(const char* name, long defaultValue = 0);
+      float getFloat(const char* name, float defaultValue = 0);
+
+      // Accepts true/false, 1/0, yes/no and on/off.  A parameter without a value is true.
+      bool getBool(const char* name, bool defaultValue = false);
+
+      size_t size();
+      const char* nameAt(size_t index);
+      const char* valueAt(size_t index);
+
+    protected:
+      // Called on first access.  Implementations call add() for each parameter.
+      virtual void load() = 0;
+
+      void add(const char* name, const char* value);
+
+    private:
+      struct Param {
+        const char* name;
+        const char* value;
+      };
+
+      Param params[RICH_HTTP_MAX_QUERY_PARAMS];
+      size_t count;
+      bool loaded;
+
+      inline void ensureLoaded() {
+        if (! loaded) {
+          loaded = true;
+          load();
+        }
+      }
+  };
+};
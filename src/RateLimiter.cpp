@@ -0,0 +1,98 @@
+#include "RateLimiter.h"
+
+#include <algorithm>
+
+namespace RichHttp {
+  RateLimiter::RateLimiter(uint16_t requests, uint32_t periodMillis)
+    : requests(requests > 0 ? requests : 1)
+    , periodMillis(periodMillis > 0 ? periodMillis : 1)
+  {
+    reset();
+  }
+
+  void RateLimiter::reset() {
+    memset(buckets, 0, sizeof(buckets));
+
+    allowed = 0;
+    limited = 0;
+    evictions = 0;
+  }
+
+  bool RateLimiter::allow(uint32_t client, uint16_t& retryAfter) {
+    return allow(client, millis(), retryAfter);
+  }
+
+  bool RateLimiter::allow(uint32_t client, uint32_t now, uint16_t& retryAfter) {
+    const uint64_t capacity = static_cast<uint64_t>(requests) * periodMillis;
+    Bucket& bucket = findBucket(client, now);
+
+    uint32_t elapsed = now - bucket.updatedAt;
+    if (elapsed >= periodMillis) {
+      bucket.tokens = capacity;
+    } else {
+      bucket.tokens = std::min(capacity, bucket.tokens + static_cast<uint64_t>(elapsed) * requests);
+    }
+    bucket.updatedAt = now;
+
+    if (bucket.tokens >= periodMillis) {
+      bucket.tokens -= periodMillis;
+      allowed++;
+      return true;
+    }
+
+    // Less than periodMillis tokens are left here
+    uint64_t waitMillis = (periodMillis - bucket.tokens + requests - 1) / requests;
+    retryAfter = std::min<uint64_t>(UINT16_MAX, std::max<uint64_t>(1, (waitMillis + 999) / 1000));
+    limited++;
+
+    return false;
+  }
+
+  RateLimiter::Bucket& RateLimiter::findBucket(uint32_t client, uint32_t now) {
+    const size_t start = (client * 2654435761u) % RICH_HTTP_RATE_LIMIT_MAX_CLIENTS;
+    Bucket* victim = nullptr;
+
+    for (size_t i = 0; i < RICH_HTTP_RATE_LIMIT_PROBES && i < RICH_HTTP_RATE_LIMIT_MAX_CLIENTS; ++i) {
+      Bucket& bucket = buckets[(start + i) % RICH_HTTP_RATE_LIMIT_MAX_CLIENTS];
+
+      if (bucket.client == client) {
+        return bucket;
+      }
+
+      if (bucket.client == 0) {
+        if (victim == nullptr || victim->client != 0) {
+          victim = &bucket;
+        }
+      } else if (victim == nullptr || (victim->client != 0 && now - bucket.updatedAt > now - victim->updatedAt)) {
+        victim = &bucket;
+      }
+    }
+
+    if (victim->client != 0) {
+      evictions++;
+    }
+
+    // New clients start with a full bucket
+    victim->client = client;
+    victim->tokens = static_cast<uint64_t>(requests) * periodMillis;
+    victim->updatedAt = now;
+
+    return *victim;
+  }
+
+  void RateLimiter::toJson(JsonObject json) const {
+    size_t clients = 0;
+    for (size_t i = 0; i < RICH_HTTP_RATE_LIMIT_MAX_CLIENTS; ++i) {
+      if (buckets[i].client != 0) {
+        clients++;
+      }
+    }
+
+    json["requests"] = requests;
+    json["period_ms"] = periodMillis;
+    json["clients"] = clients;
+    json["allowed"] = allowed;
+    json["limited"] = limited;
+    json["evictions"] = evictions;
+  }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Number of clients tracked by each RateLimiter.  When the table is full, the least
+// recently seen client near the new client's slot is evicted.
+#ifndef RICH_HTTP_RATE_LIMIT_MAX_CLIENTS
+#define RICH_HTTP_RATE_LIMIT_MAX_CLIENTS 16
+#endif
+
+// Number of slots searched for a client, starting at the slot its address hashes to.
+#ifndef RICH_HTTP_RATE_LIMIT_PROBES
+#define RICH_HTTP_RATE_LIMIT_PROBES 4
+#endif
+
+namespace RichHttp {
+  /**
+   * Per-client token buckets keyed by IPv4 address.  Each client may make a burst of up to
+   * `requests` requests, and its bucket refills at `requests` per `periodMillis`.
+   *
+   * Buckets are stored in a fixed-size table, so tracking a new client never allocates.
+   */
+  class RateLimiter {
+    public:
+      RateLimiter(uint16_t requests, uint32_t periodMillis = 1000);
+
+      // Takes a token for the client.  Returns false if none are left, in which case
+      // retryAfter is set to the number of seconds until one will be available.
+      bool allow(uint32_t client, uint16_t& retryAfter);
+      bool allow(uint32_t client, uint32_t now, uint16_t& retryAfter);
+
+      void reset();
+      void toJson(JsonObject json) const;
+
+    private:
+      struct Bucket {
+        // In units of 1/periodMillis of a request.  64 bits since a full bucket holds
+        // requests * periodMillis.
+        uint64_t tokens;
+        // 0 marks an unused slot.  0.0.0.0 can't be a client address.
+        uint32_t client;
+        uint32_t updatedAt;
+      };
+
+      const uint16_t requests;
+      const uint32_t periodMillis;
+      Bucket buckets[RICH_HTTP_RATE_LIMIT_MAX_CLIENTS];
+
+      uint32_t allowed;
+      uint32_t limited;
+      uint32_t evictions;
+
+      Bucket& findBucket(uint32_t client, uint32_t now);
+  };
+};
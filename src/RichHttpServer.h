@@ -5,12 +5,56 @@
 #include <memory>
 
 #include "AuthProviders.h"
+#include "HeapStats.h"
+#include "RouteTable.h"
+#include "SwappableRoutes.h"
+#include "AdmissionControl.h"
+#include "RateLimiter.h"
+#include "Middleware.h"
+#include "RouteMethods.h"
+#include "CorsPolicy.h"
+#include "AccessLog.h"
+#include "Pagination.h"
+#include "KeepAlive.h"
+#include "UploadSink.h"
+#include "SingleFlight.h"
+#include "HeaderSet.h"
+#include "JsonSchema.h"
 
 #include "Platforms/Generics.h"
 #include "Platforms/PlatformESP32.h"
 #include "Platforms/PlatformESP8266.h"
 #include "Platforms/PlatformAsyncWebServer.h"
 
+namespace RichHttp {
+  // Human readable name for a method.  Works with each platform's method type since they
+  // all use the same constant names.
+  template <class THttpMethod>
+  const char* methodName(THttpMethod method) {
+    if (method == HTTP_GET) return "GET";
+    if (method == HTTP_POST) return "POST";
+    if (method == HTTP_PUT) return "PUT";
+    if (method == HTTP_PATCH) return "PATCH";
+    if (method == HTTP_DELETE) return "DELETE";
+    if (method == HTTP_HEAD) return "HEAD";
+    if (method == HTTP_OPTIONS) return "OPTIONS";
+    return "ANY";
+  }
+
+  template <class THttpMethod>
+  uint8_t methodBit(THttpMethod method) {
+    if (method == HTTP_ANY) return MethodBits::ANY;
+    if (method == HTTP_GET) return MethodBits::GET;
+    if (method == HTTP_POST) return MethodBits::POST;
+    if (method == HTTP_PUT) return MethodBits::PUT;
+    if (method == HTTP_PATCH) return MethodBits::PATCH;
+    if (method == HTTP_DELETE) return MethodBits::DELETE;
+    if (method == HTTP_HEAD) return MethodBits::HEAD;
+    if (method == HTTP_OPTIONS) return MethodBits::OPTIONS;
+    return MethodBits::ANY;
+  }
+};
+
 template <class Config>
 class HandlerBuilder;
 
@@ -20,7 +64,14 @@ public:
   RichHttpServer(int port, const AuthProvider& authProvider)
     : Config::ServerType(port)
     , authProvider(authProvider)
-  { }
+    , fnWrapperBuilder(this, &this->authProvider, &middleware, &routeMethods, &cors)
+    , nextRouteId(0)
+    , keepAlive(nullptr)
+  {
+    this->addHandler(new typename Config::AdmissionHandlerType(*this, admissionControl, fnWrapperBuilder));
+    this->addHandler(new typename Config::PreflightHandlerType(routeMethods, cors, fnWrapperBuilder));
+    fnWrapperBuilder.setNotFoundFn(nullptr);
+  }
   ~RichHttpServer() { };
 
   HandlerBuilder<Config>& buildHandler(const String& path, bool disableAuth = false) {
@@ -29,17 +80,174 @@ public:
     return *builder;
   }
 
+  // Frees the builders.  Routes they added stay registered, since handlers don't refer to
+  // their builders.  Use addSwappableRoutes() for routes which change at runtime.
   void clearBuilders() {
     handlerBuilders.clear();
   }
 
+  // Registers a constexpr route table (see RouteTable.h).  The table must outlive the
+  // server, which is the case for a static or PROGMEM array.
+  template <size_t N>
+  void addRoutes(const RichHttp::Route<Config> (&routes)[N]) {
+    addRoutes(routes, N);
+  }
+
+  void addRoutes(const RichHttp::Route<Config>* routes, size_t numRoutes) {
+    addSwappableRoutes().swap(routes, numRoutes);
+  }
+
+  // Registers an empty route table which can be replaced at runtime (see SwappableRoutes.h).
+  // Replaced tables are freed by reclaimRoutes(), or by the next swap.
+  RichHttp::SwappableRoutes<Config>& addSwappableRoutes() {
+    return addRouteTableHandler(new typename Config::RouteTableHandlerType(
+      fnWrapperBuilder,
+      nextRouteId
+    ));
+  }
+
+  // Serves a route table shared with other servers, e.g. the same API on a second port.
+  // Only a small handler is allocated; the routes aren't copied.  Requests are checked with
+  // this server's auth provider and middleware.  The table must outlive the server.
+  void attachRoutes(RichHttp::SwappableRoutes<Config>& routes) {
+    addRouteTableHandler(new typename Config::RouteTableHandlerType(fnWrapperBuilder, routes));
+  }
+
+  // Frees route tables which have been swapped out once no request is using them.  Called
+  // by handleClient(); call it from loop() with the async server.
+  void reclaimRoutes() {
+    for (RichHttp::SwappableRoutes<Config>* routes : swappableRoutes) {
+      routes->reclaim();
+    }
+  }
+
   const AuthProvider* getAuthProvider() const {
     return &authProvider;
   }
 
+  // Adds middleware which runs around the handler of every route, in the order added.  The
+  // middleware must outlive the server.  Returns false if RICH_HTTP_MAX_MIDDLEWARE has been
+  // reached.
+  bool use(RichHttp::Middleware& middleware) {
+    return this->middleware.add(middleware);
+  }
+
+  // Shared by all of this server's handlers
+  typename Config::FnWrapperBuilderType* getFnWrapperBuilder() {
+    return &fnWrapperBuilder;
+  }
+
+  // Thresholds for shedding load with 503s.  Disabled until configured.
+  RichHttp::AdmissionControl& getAdmissionControl() {
+    return admissionControl;
+  }
+
+  // Cross-origin headers for all routes and OPTIONS responses.  Disabled until an origin is
+  // set.
+  RichHttp::CorsPolicy& getCors() {
+    return cors;
+  }
+
+  // Methods registered for each path.  Used to answer OPTIONS and HEAD requests.
+  RichHttp::RouteMethods& getRouteMethods() {
+    return routeMethods;
+  }
+
+  // Records every request served by a route added with on() or addRoutes() in log, along with
+  // requests rejected by auth, rate limits or admission control, preflight requests and
+  // requests no route matched.  The log must outlive the server.
+  void setAccessLog(RichHttp::AccessLog& log) {
+    fnWrapperBuilder.setAccessLog(&log);
+  }
+
+  // Hides the server's onNotFound() so that requests no route matched are still logged.  They
+  // are logged as 404s whatever fn responds with.
+  void onNotFound(typename Config::FnWrapperBuilderType::not_found_fn_type fn) {
+    fnWrapperBuilder.setNotFoundFn(fn);
+  }
+
+  // Closes persistent connections according to policy, which must outlive the server.  Every
+  // request counts, including rejections, preflight requests and 404s.  Only supported by the
+  // builtin ESP8266WebServer (core 3.0 and later); other builtin servers close every
+  // connection, and ESPAsyncWebServer manages its own.
+  void setKeepAlive(RichHttp::KeepAlivePolicy& policy) {
+    keepAlive = &policy;
+    fnWrapperBuilder.setKeepAlive(&policy);
+  }
+
+  // Hides the builtin server's handleClient().  Requests already sent on a kept-alive
+  // connection are served in the same call, idle connections are closed, and swapped out
+  // route tables are freed.
+  void handleClient() {
+    serveRequest();
+
+    if (keepAlive != nullptr) {
+      for (size_t i = 1; i < RICH_HTTP_KEEP_ALIVE_PIPELINE_DEPTH && keepAlive->isOpen() && this->client().available(); ++i) {
+        serveRequest();
+      }
+
+      if (keepAlive->isIdle(millis())) {
+        this->client().stop();
+        keepAlive->onClose();
+      }
+    }
+
+    reclaimRoutes();
+  }
+
+  // Keeps the request header name, which must outlive the server (e.g. a string literal),
+  // for all routes.  Other headers are skipped when requests are parsed, except
+  // Authorization.  Returns false if RICH_HTTP_MAX_COLLECTED_HEADERS has been reached.
+  bool collectHeader(const char* name) {
+    if (! collectedHeaders.add(name)) {
+      return false;
+    }
+
+    fnWrapperBuilder.setCollectedHeaders(&collectedHeaders);
+    return true;
+  }
+
+  // Allocates ids identifying routes in the access log.  Returns the first of count
+  // consecutive ids.
+  uint16_t reserveRouteIds(size_t count) {
+    uint16_t first = nextRouteId;
+    nextRouteId += count;
+    return first;
+  }
+
 private:
+  // Serves the next request on the builtin server, if there is one.  The request was
+  // counted against the keep-alive policy when it arrived, and the response marks the
+  // connection's last activity.
+  void serveRequest() {
+    uint32_t responses = fnWrapperBuilder.getResponseCount();
+
+    Config::ServerType::handleClient();
+
+    if (keepAlive != nullptr && fnWrapperBuilder.getResponseCount() != responses) {
+      keepAlive->onResponse(millis());
+    }
+  }
+
+  RichHttp::SwappableRoutes<Config>& addRouteTableHandler(typename Config::RouteTableHandlerType* handler) {
+    swappableRoutes.push_back(&handler->getRoutes());
+    routeMethods.add(handler->getRoutes());
+    this->addHandler(handler);
+
+    return handler->getRoutes();
+  }
+
   std::vector<std::shared_ptr<HandlerBuilder<Config>>> handlerBuilders;
   const AuthProvider& authProvider;
+  RichHttp::AdmissionControl admissionControl;
+  RichHttp::MiddlewarePipeline middleware;
+  RichHttp::RouteMethods routeMethods;
+  RichHttp::CorsPolicy cors;
+  typename Config::FnWrapperBuilderType fnWrapperBuilder;
+  uint16_t nextRouteId;
+  RichHttp::KeepAlivePolicy* keepAlive;
+  RichHttp::HeaderSet collectedHeaders;
+  std::vector<RichHttp::SwappableRoutes<Config>*> swappableRoutes;
 };
 
 template <class Config>
@@ -47,9 +255,11 @@ class HandlerBuilder {
 public:
   HandlerBuilder(RichHttpServer<Config>& server, const String& path, const bool disableAuth = false)
     : disableAuth(disableAuth)
+    , rateLimiter(nullptr)
+    , singleFlight(nullptr)
     , path(path)
     , server(server)
-    , fnWrapperBuilder(new typename Config::FnWrapperBuilderType(&server, server.getAuthProvider()))
+    , fnWrapperBuilder(server.getFnWrapperBuilder())
   { }
 
   HandlerBuilder& setDisableAuthOverride() {
@@ -57,48 +267,225 @@ public:
     return *this;
   }
 
+  // Limits how often each client can call the routes subsequently added to this builder.
+  // The limiter must outlive the server, and may be shared between builders.  Upload chunks
+  // aren't counted; use a server-wide limiter (AdmissionControl::setRateLimiter) to
+  // reject uploads before they're read.
+  HandlerBuilder& setRateLimiter(RichHttp::RateLimiter& rateLimiter) {
+    this->rateLimiter = &rateLimiter;
+    return *this;
+  }
+
+  // Identical GET requests to the routes subsequently added to this builder which arrive
+  // together share one handler call and serialized body (see SingleFlight.h).  singleFlight
+  // must outlive the server, and may be shared between builders.
+  HandlerBuilder& setSingleFlight(RichHttp::SingleFlight& singleFlight) {
+    this->singleFlight = &singleFlight;
+    return *this;
+  }
+
+  // Checks the JSON bodies of requests to the routes subsequently added to this builder
+  // against rules (see JsonSchema.h), which must outlive the server.  The rules are compiled
+  // once here.  Bodies which don't follow them are answered with 400 before the handler
+  // runs.  Only POST, PUT and PATCH routes without uploads are checked.
+  template <size_t N>
+  HandlerBuilder& setJsonSchema(const RichHttp::JsonRule (&rules)[N]) {
+    this->jsonSchema = std::make_shared<const RichHttp::JsonSchema>(rules, N);
+    return *this;
+  }
+
+  // Declares a request header read by this builder's routes, so the server keeps it (see
+  // RichHttpServer::collectHeader).  Handlers read it with request.getHeader(name).
+  HandlerBuilder& collectHeader(const char* name) {
+    server.collectHeader(name);
+    return *this;
+  }
+
+  // Requests to this path are admitted even when the server is shedding load
+  HandlerBuilder& setPriority() {
+    server.getAdmissionControl().addPriorityRoute(path);
+    return *this;
+  }
+
+  // On the builtin servers, OTA responses allow any origin until CORS is configured.
   HandlerBuilder<Config>& handleOTA() {
-    return on(HTTP_POST, Config::OtaSuccessHandlerFn, Config::OtaHandlerFn);
+    return on(HTTP_POST, Config::otaFn(Config::OtaSuccessHandlerFn, server.getCors()), Config::OtaHandlerFn);
+  }
+
+  // Accepts a patch generated by tools/delta_patch.py against the running sketch
+  // instead of a full image.
+  HandlerBuilder<Config>& handleDeltaOTA() {
+    return on(HTTP_POST, Config::otaFn(Config::DeltaOtaSuccessHandlerFn, server.getCors()), Config::DeltaOtaHandlerFn);
+  }
+
+  // Serves per-route heap usage as JSON.  Only populated when RICH_HTTP_HEAP_STATS is
+  // defined.
+  HandlerBuilder<Config>& handleHeapStats() {
+    return on(HTTP_GET, [](typename Config::RequestContextType& request) {
+      request.response.sendStream(200, "application/json", RichHttp::HeapStats::snapshot());
+    });
+  }
+
+  // Serves admission control settings and counts of admitted and shed requests as JSON.
+  HandlerBuilder<Config>& handleAdmissionStats() {
+    RichHttpServer<Config>& server = this->server;
+
+    return on(HTTP_GET, [&server](typename Config::RequestContextType& request) {
+      server.getAdmissionControl().toJson(request.response.json.template to<JsonObject>());
+    });
+  }
+
+  // Streams the entries in log as JSON or CSV
+  HandlerBuilder<Config>& handleAccessLog(
+    const RichHttp::AccessLog& log,
+    RichHttp::AccessLog::Format format = RichHttp::AccessLog::Format::JSON
+  ) {
+    return on(HTTP_GET, [&log, format](typename Config::RequestContextType& request) {
+      const char* type = format == RichHttp::AccessLog::Format::CSV ? "text/csv" : "application/json";
+      request.response.sendStream(200, type, log.snapshot(format));
+    });
+  }
+
+  // Writes files uploaded to this path with sink (see UploadSink.h), and responds with the
+  // upload's statistics.  Chunks go straight to the sink instead of through a request
+  // context.  The sink must outlive the server, and its loop() should be called from the
+  // sketch's loop().
+  HandlerBuilder<Config>& handleUpload(RichHttp::UploadSink& sink) {
+    return on(
+      HTTP_POST,
+      [&sink](typename Config::RequestContextType& request) {
+        switch (sink.takeResult(RichHttp::Generics::uploadOwner(request))) {
+          case RichHttp::UploadSink::Result::BUSY:
+            request.response.sendRaw(409, "text/plain", "Another upload is in progress");
+            return;
+          case RichHttp::UploadSink::Result::MISSING:
+            request.response.sendRaw(400, "text/plain", "No file uploaded");
+            return;
+          case RichHttp::UploadSink::Result::FAILED:
+            request.response.setCode(500);
+            request.response.json["success"] = false;
+            break;
+          case RichHttp::UploadSink::Result::SUCCESS:
+            request.response.json["success"] = true;
+            break;
+        }
+
+        sink.toJson(request.response.json.template createNestedObject("stats"));
+      },
+      RichHttp::Generics::UploadSinkFn{ &sink }
+    );
+  }
+
+  // Serves a collection one page at a time (see Pagination.h).  Clients pass "limit" and
+  // "cursor" query parameters, and each response links to the next page.  nextFn is called
+  // as nextFn(request, cursor, item) to fill item with the item at cursor and advance cursor
+  // to the following item, and returns false once the collection is exhausted.
+  template <class Fn>
+  HandlerBuilder<Config>& onCollection(Fn nextFn) {
+    return on(HTTP_GET, [nextFn](typename Config::RequestContextType& request) {
+      RichHttp::Page page(request.queryParams, request.response);
+
+      if (! page.isValid()) {
+        request.response.sendRaw(400, "text/plain", "Invalid cursor or limit");
+        return;
+      }
+
+      bool filled = page.fill([&nextFn, &request](uint32_t& cursor, JsonVariant item) {
+        return nextFn(request, cursor, item);
+      });
+
+      if (! filled) {
+        request.response.sendRaw(500, "text/plain", "Item too large for response");
+      }
+    });
   }
 
-  // Add handlers to the attached server.
+  // Add handlers to the attached server.  fn is registered as-is, without a request
+  // context, so middleware, access logging and heap stats don't apply to it.
   HandlerBuilder<Config>& onSimple(const typename Config::HttpMethod verb, typename Config::RequestHandlerFn::type fn) {
     if (! this->disableAuth) {
       fn = fnWrapperBuilder->buildAuthedFn(fn);
     }
 
+    server.getRouteMethods().add(path, RichHttp::methodBit(verb));
     server.addHandler(new typename Config::RequestHandlerType(verb, path.c_str(), fn, nullptr, nullptr));
     return *this;
   }
 
-  HandlerBuilder<Config>& on(
-    const typename Config::HttpMethod verb,
-    typename Config::ContextHandlerFn::type contextFn,
-    typename Config::UploadContextHandlerFn::type uploadFn = nullptr
-  ) {
-    bool disableBody = uploadFn == nullptr || verb == HTTP_GET;
-    typename Config::BodyRequestHandlerFn::type wrappedFn = fnWrapperBuilder->wrapContextFn(contextFn, disableBody);
-    typename Config::UploadRequestHandlerFn::type wrappedUploadFn = nullptr;
-
-    if (uploadFn != nullptr) {
-      wrappedUploadFn = fnWrapperBuilder->wrapUploadContextFn(uploadFn);
-    }
+  // Handlers are stored by type in a single compiled handler per route.  fn and uploadFn
+  // can be any callable accepting a Config::RequestContextType&.
+  template <class Fn>
+  HandlerBuilder<Config>& on(const typename Config::HttpMethod verb, Fn contextFn) {
+    return addCompiledHandler(verb, contextFn, RichHttp::Generics::NoUploadFn());
+  }
 
-    if (! this->disableAuth) {
-      wrappedFn = fnWrapperBuilder->buildAuthedBodyFn(wrappedFn);
+  template <class Fn>
+  HandlerBuilder<Config>& on(const typename Config::HttpMethod verb, Fn contextFn, std::nullptr_t) {
+    return addCompiledHandler(verb, contextFn, RichHttp::Generics::NoUploadFn());
+  }
 
-      if (wrappedUploadFn) {
-        wrappedUploadFn = fnWrapperBuilder->buildAuthedUploadFn(wrappedUploadFn);
-      }
+  // An empty uploadFn (e.g. a default constructed std::function) registers a route without
+  // uploads, as if none had been passed.
+  template <class Fn, class UploadFn>
+  HandlerBuilder<Config>& on(const typename Config::HttpMethod verb, Fn contextFn, UploadFn uploadFn) {
+    if (RichHttp::Generics::isEmptyFn(uploadFn)) {
+      return addCompiledHandler(verb, contextFn, RichHttp::Generics::NoUploadFn());
     }
 
-    server.addHandler(new typename Config::RequestHandlerType(verb, path.c_str(), nullptr, wrappedFn, wrappedUploadFn));
-    return *this;
+    return addCompiledHandler(verb, contextFn, uploadFn);
   }
 
 private:
   bool disableAuth;
+  RichHttp::RateLimiter* rateLimiter;
+  RichHttp::SingleFlight* singleFlight;
+  std::shared_ptr<const RichHttp::JsonSchema> jsonSchema;
   const String path;
   RichHttpServer<Config>& server;
   typename Config::FnWrapperBuilderType* fnWrapperBuilder;
+
+  template <class Fn, class UploadFn>
+  HandlerBuilder<Config>& addCompiledHandler(const typename Config::HttpMethod verb, Fn contextFn, UploadFn uploadFn) {
+    if (this->singleFlight != nullptr && verb == HTTP_GET) {
+      return registerCompiledHandler(
+        verb,
+        RichHttp::SingleFlightFn<Fn>{ .fn = contextFn, .singleFlight = this->singleFlight, .pattern = path },
+        uploadFn
+      );
+    }
+
+    // Only methods whose requests carry a body are validated
+    if (this->jsonSchema != nullptr
+      && (verb == HTTP_POST || verb == HTTP_PUT || verb == HTTP_PATCH)
+      && ! RichHttp::Generics::UploadFnTraits<UploadFn>::hasUpload)
+    {
+      return registerCompiledHandler(
+        verb,
+        RichHttp::ValidatedFn<Fn>{ .fn = contextFn, .schema = this->jsonSchema },
+        uploadFn
+      );
+    }
+
+    return registerCompiledHandler(verb, contextFn, uploadFn);
+  }
+
+  template <class Fn, class UploadFn>
+  HandlerBuilder<Config>& registerCompiledHandler(const typename Config::HttpMethod verb, Fn contextFn, UploadFn uploadFn) {
+    RichHttp::RouteHeapStats* stats = RichHttp::HeapStats::registerRoute(path, RichHttp::methodName(verb));
+    size_t pathId = server.getRouteMethods().add(path, RichHttp::methodBit(verb));
+
+    server.addHandler(new typename Config::template CompiledRequestHandlerType<Fn, UploadFn>(
+      *fnWrapperBuilder,
+      verb,
+      path.c_str(),
+      contextFn,
+      uploadFn,
+      this->disableAuth,
+      this->rateLimiter,
+      stats,
+      server.reserveRouteIds(1),
+      pathId
+    ));
+    return *this;
+  }
 };
\ No newline at end of file
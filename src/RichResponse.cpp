@@ -1,16 +1,125 @@
 #include "RichResponse.h"
 
+#include <string.h>
+#include <algorithm>
+
 namespace RichHttp {
+  // Counts what's written to it
+  class CountingPrint : public Print {
+    public:
+      CountingPrint() : count(0) { }
+
+      virtual size_t write(uint8_t) override {
+        ++count;
+        return 1;
+      }
+
+      virtual size_t write(const uint8_t*, size_t size) override {
+        count += size;
+        return size;
+      }
+
+      size_t count;
+  };
+
+  size_t BodyWriter::length() const {
+    CountingPrint counter;
+    writeTo(counter);
+    return counter.count;
+  }
+
+  size_t BodyWriter::read(uint8_t* buffer, size_t size, size_t offset) const {
+    WindowPrint window(buffer, size, offset);
+    writeTo(window);
+    return window.written();
+  }
+
+  WindowPrint::WindowPrint(uint8_t* buffer, size_t size, size_t offset)
+    : buffer(buffer)
+    , size(size)
+    , offset(offset)
+    , position(0)
+    , used(0)
+  { }
+
+  size_t WindowPrint::write(uint8_t c) {
+    return write(&c, 1);
+  }
+
+  size_t WindowPrint::write(const uint8_t* data, size_t length) {
+    size_t end = position + length;
+
+    // Copy the part of [position, end) which overlaps [offset + used, offset + size)
+    size_t from = std::max(position, offset + used);
+    size_t to = std::min(end, offset + size);
+
+    if (from < to) {
+      memcpy(buffer + used, data + (from - position), to - from);
+      used += to - from;
+    }
+
+    position = end;
+    return length;
+  }
+
+  size_t StringPrint::write(uint8_t c) {
+    dest += static_cast<char>(c);
+    return 1;
+  }
+
+  size_t StringPrint::write(const uint8_t* data, size_t size) {
+    dest.concat(reinterpret_cast<const char*>(data), size);
+    return size;
+  }
+
   Response::Response(JsonDocument& json)
     : json(json)
     , responseCode(200)
+    , codeSet(false)
+    , buffer(nullptr)
+    , bufferLength(0)
+    , bufferProgmem(false)
   { }
 
   Response::~Response() { }
 
   void Response::sendRaw(int responseCode, const char* responseType, const char* body) {
-    this->responseCode = responseCode;
+    clearBody();
+    setCode(responseCode);
     this->responseType = responseType;
     this->rawBody = body;
   }
+
+  void Response::sendBuffer(int responseCode, const char* responseType, const uint8_t* body, size_t length) {
+    clearBody();
+    setCode(responseCode);
+    this->responseType = responseType;
+    this->buffer = body;
+    this->bufferLength = length;
+    this->bufferProgmem = false;
+  }
+
+  void Response::sendBuffer_P(int responseCode, const char* responseType, PGM_P body, size_t length) {
+    sendBuffer(responseCode, responseType, reinterpret_cast<const uint8_t*>(body), length);
+    this->bufferProgmem = true;
+  }
+
+  void Response::sendStream(int responseCode, const char* responseType, std::shared_ptr<BodyWriter> writer) {
+    clearBody();
+    setCode(responseCode);
+    this->responseType = responseType;
+    this->bodyWriter = writer;
+  }
+
+  void Response::clearBody() {
+    rawBody = String();
+    buffer = nullptr;
+    bufferLength = 0;
+    bufferProgmem = false;
+    bodyWriter.reset();
+  }
+
+  void Response::addHeader(const String& name, const String& value) {
+    headers.push_back(std::make_pair(name, value));
+  }
 }
\ No newline at end of file
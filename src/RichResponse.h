@@ -1,8 +1,72 @@
 #pragma once
 
+#include <Arduino.h>
 #include <ArduinoJson.h>
 
+#include <memory>
+#include <utility>
+#include <vector>
+
 namespace RichHttp {
+  /**
+   * Renders a response body directly to the connection rather than into a buffer.  Must
+   * produce the same output each time it's called, since it may be rendered once to measure
+   * its length and again (possibly in pieces) to send it.
+   */
+  class BodyWriter {
+    public:
+      virtual ~BodyWriter() = default;
+      virtual void writeTo(Print& out) const = 0;
+
+      // Renders the body without storing it.  Writers which know their length can override
+      // this.
+      virtual size_t length() const;
+
+      // Copies up to size bytes of the body starting at offset into buffer, for servers which
+      // send it in chunks.  Returns the number of bytes copied.  Renders the body from the
+      // start, so writers of long bodies should override this to resume near offset.
+      virtual size_t read(uint8_t* buffer, size_t size, size_t offset) const;
+  };
+
+  /**
+   * Print which keeps only the bytes of its output falling within a window, i.e. one chunk
+   * of a body which is rendered from the start for each chunk.
+   */
+  class WindowPrint : public Print {
+    public:
+      WindowPrint(uint8_t* buffer, size_t size, size_t offset);
+
+      virtual size_t write(uint8_t c) override;
+      virtual size_t write(const uint8_t* data, size_t size) override;
+
+      // Number of bytes copied into the buffer
+      inline size_t written() const { return used; }
+
+      // Number of bytes of output seen so far, including those outside the window
+      inline size_t getPosition() const { return position; }
+
+    private:
+      uint8_t* buffer;
+      size_t size;
+      size_t offset;
+      size_t position;
+      size_t used;
+  };
+
+  /**
+   * Print which appends to a String
+   */
+  class StringPrint : public Print {
+    public:
+      StringPrint(String& dest) : dest(dest) { }
+
+      virtual size_t write(uint8_t c) override;
+      virtual size_t write(const uint8_t* data, size_t size) override;
+
+    private:
+      String& dest;
+  };
+
   class Response {
     public:
       Response(JsonDocument& json);
@@ -11,17 +75,56 @@ namespace RichHttp {
     JsonDocument& json;
 
     void sendRaw(int responseCode, const char* responseType, const char* body);
-    void setCode(int responseCode) { this->responseCode = responseCode; }
+
+    // Sends length bytes of body without copying them, so it can hold binary data including
+    // NUL bytes.  body isn't owned by the response and must stay valid until the response has
+    // been sent, which with the async server is after the handler returns: use a static or
+    // global buffer, or sendStream() to hand over ownership.
+    void sendBuffer(int responseCode, const char* responseType, const uint8_t* body, size_t length);
+
+    // Same as sendBuffer, for a body stored in flash (PROGMEM)
+    void sendBuffer_P(int responseCode, const char* responseType, PGM_P body, size_t length);
+
+    // Streams the body from writer when the response is sent, without buffering it
+    void sendStream(int responseCode, const char* responseType, std::shared_ptr<BodyWriter> writer);
+    void setCode(int responseCode) {
+      this->responseCode = responseCode;
+      this->codeSet = true;
+    }
 
     inline bool isSetBody() const { return rawBody.length() > 0; }
+    // True if the code was set with setCode() or one of the send methods
+    inline bool isSetCode() const { return codeSet; }
+    inline bool isSetStream() const { return bodyWriter != nullptr; }
+    inline const std::shared_ptr<BodyWriter>& getBodyWriter() const { return bodyWriter; }
+    inline bool isSetBuffer() const { return buffer != nullptr; }
+    inline const uint8_t* getBuffer() const { return buffer; }
+    inline size_t getBufferLength() const { return bufferLength; }
+    // True if the buffer is in flash
+    inline bool isBufferProgmem() const { return bufferProgmem; }
     inline const String& getBody() const { return rawBody; }
     inline const String& getBodyType() const { return responseType; }
     inline int getCode() const { return this->responseCode; }
+    // True if a body or JSON was set, as opposed to just a code
+    inline bool hasContent() const { return isSetStream() || isSetBuffer() || isSetBody() || ! json.isNull(); }
+
+    // Extra headers sent with the response
+    void addHeader(const String& name, const String& value);
+    inline const std::vector<std::pair<String, String>>& getHeaders() const { return headers; }
 
     private:
       int responseCode;
+      bool codeSet;
       String rawBody;
+      const uint8_t* buffer;
+      size_t bufferLength;
+      bool bufferProgmem;
       String responseType;
+      std::shared_ptr<BodyWriter> bodyWriter;
+      std::vector<std::pair<String, String>> headers;
+
+      // Called by each send method, so the last one called decides the body
+      void clearBody();
 
       // prevent accidental copies
       Response(Response& other);
@@ -0,0 +1,81 @@
+#include "RouteMethods.h"
+#include "RouteTable.h"
+
+namespace RichHttp {
+  // Indexed by bit position in MethodBits
+  static const char ALLOW_NAMES[][8] PROGMEM = {
+    "GET",
+    "HEAD",
+    "POST",
+    "PUT",
+    "PATCH",
+    "DELETE",
+    "OPTIONS"
+  };
+
+  size_t RouteMethods::add(const String& path, uint8_t methods) {
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (entries[i].path == path) {
+        entries[i].methods |= methods;
+        return i;
+      }
+    }
+
+    entries.push_back(Entry{ path, methods });
+
+    Entry& entry = entries.back();
+    entry.pattern = Routes::parsePattern(path.c_str(), entry.types);
+
+    return entries.size() - 1;
+  }
+
+  void RouteMethods::add(const Source& source) {
+    sources.push_back(&source);
+  }
+
+  uint8_t RouteMethods::methodsFor(const char* path, size_t length) const {
+    uint8_t methods = 0;
+
+    for (const Entry& entry : entries) {
+      if (Routes::matches(entry.pattern.c_str(), path, length, entry.types)) {
+        methods |= entry.methods;
+      }
+    }
+
+    for (const Source* source : sources) {
+      methods |= source->methodsFor(path, length);
+    }
+
+    return methods;
+  }
+
+  String RouteMethods::allowHeader(uint8_t methods) {
+    if (methods & MethodBits::GET) {
+      methods |= MethodBits::HEAD;
+    }
+    methods |= MethodBits::OPTIONS;
+
+    String allow;
+
+    for (size_t i = 0; i < sizeof(ALLOW_NAMES) / sizeof(ALLOW_NAMES[0]); ++i) {
+      if (methods & (1 << i)) {
+        if (allow.length() > 0) {
+          allow += F(", ");
+        }
+        allow += FPSTR(ALLOW_NAMES[i]);
+      }
+    }
+
+    return allow;
+  }
+
+  const __FlashStringHelper* RouteMethods::nameOf(uint8_t method) {
+    for (size_t i = 0; i < sizeof(ALLOW_NAMES) / sizeof(ALLOW_NAMES[0]); ++i) {
+      if (method == (1 << i)) {
+        return FPSTR(ALLOW_NAMES[i]);
+      }
+    }
+
+    return F("ANY");
+  }
+};
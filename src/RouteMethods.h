@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "PathValues.h"
+
+namespace RichHttp {
+  // Platform-independent set of HTTP methods, used to answer OPTIONS and HEAD requests
+  namespace MethodBits {
+    static const uint8_t GET = 1 << 0;
+    static const uint8_t HEAD = 1 << 1;
+    static const uint8_t POST = 1 << 2;
+    static const uint8_t PUT = 1 << 3;
+    static const uint8_t PATCH = 1 << 4;
+    static const uint8_t DELETE = 1 << 5;
+    static const uint8_t OPTIONS = 1 << 6;
+    static const uint8_t ANY = 0x7F;
+  };
+
+  // Defined in RichHttpServer.h, once each platform's method constants are available.
+  template <class THttpMethod>
+  uint8_t methodBit(THttpMethod method);
+
+  /**
+   * Methods registered for each path, across all of a server's routes.  Filled in as routes are
+   * added, so OPTIONS and HEAD requests can be answered without scanning handlers or running
+   * user code.
+   *
+   * Routes keep the id of their path, so a GET route can check whether it answers HEAD
+   * requests without matching the request against every other route.
+   */
+  class RouteMethods {
+    public:
+      /**
+       * Anything else which can report the methods it serves for a path, e.g. a route table.
+       */
+      class Source {
+        public:
+          virtual ~Source() = default;
+          virtual uint8_t methodsFor(const char* path, size_t length) const = 0;
+      };
+
+      // Path variables are supported in the same form as in buildHandler().  Returns the
+      // path's id, which is shared by every route with the same path.
+      size_t add(const String& path, uint8_t methods);
+
+      // The source must outlive this object.
+      void add(const Source& source);
+
+      // Union of the methods registered for every route matching the path.  0 if none match.
+      uint8_t methodsFor(const char* path, size_t length) const;
+
+      // Methods registered for the path with the given id, so far
+      inline uint8_t methodsOf(size_t pathId) const { return entries[pathId].methods; }
+
+      // True if HEAD requests for a path with these methods should be served by its GET route,
+      // i.e. a GET route exists and no HEAD route was registered.
+      static inline bool servesHeadAsGet(uint8_t methods) {
+        return (methods & MethodBits::GET) != 0 && (methods & MethodBits::HEAD) == 0;
+      }
+
+      // Comma separated method names for an Allow header.  HEAD is included with GET, and
+      // OPTIONS is always included since it's answered automatically.
+      static String allowHeader(uint8_t methods);
+
+      // Name of a single method in MethodBits
+      static const __FlashStringHelper* nameOf(uint8_t method);
+
+    private:
+      struct Entry {
+        String path;
+        uint8_t methods;
+        // Without variable types, which are stored in types
+        String pattern;
+        PathVariableType types[RICH_HTTP_MAX_PATH_VARIABLES];
+      };
+
+      std::vector<Entry> entries;
+      std::vector<const Source*> sources;
+  };
+};
@@ -0,0 +1,106 @@
+#include "RouteTable.h"
+
+namespace RichHttp {
+  namespace Routes {
+    bool matches(
+      const char* pattern,
+      const char* path,
+      size_t length,
+      const PathVariableType* types,
+      PathValues* values
+    ) {
+      const char* end = path + length;
+      size_t variable = 0;
+
+      if (values != nullptr) {
+        values->reset();
+      }
+
+      while (true) {
+        while (*pattern == '/') {
+          ++pattern;
+        }
+        while (path < end && *path == '/') {
+          ++path;
+        }
+
+        if (*pattern == 0 || path == end) {
+          return *pattern == 0 && path == end;
+        }
+
+        if (*pattern == ':') {
+          const char* value = path;
+
+          while (*pattern != 0 && *pattern != '/') {
+            ++pattern;
+          }
+          while (path < end && *path != '/') {
+            ++path;
+          }
+
+          if (types != nullptr) {
+            if (variable >= RICH_HTTP_MAX_PATH_VARIABLES
+              || ! PathValues::parse(types[variable], value, path - value, values, variable)) {
+              return false;
+            }
+            ++variable;
+          }
+        } else {
+          while (*pattern != 0 && *pattern != '/' && path < end && *pattern == *path) {
+            ++pattern;
+            ++path;
+          }
+
+          bool patternSegmentDone = *pattern == 0 || *pattern == '/';
+          bool pathSegmentDone = path == end || *path == '/';
+
+          if (!patternSegmentDone || !pathSegmentDone) {
+            return false;
+          }
+        }
+      }
+    }
+
+    String parsePattern(const char* pattern, PathVariableType* types) {
+      String stripped;
+      size_t numVariables = 0;
+      bool inVariable = false;
+
+      for (size_t i = 0; i < RICH_HTTP_MAX_PATH_VARIABLES; ++i) {
+        types[i] = PathVariableType::STRING;
+      }
+
+      for (size_t i = 0; pattern[i] != 0; ) {
+        if (Parse::isSegmentStart(pattern, i) && pattern[i] == ':') {
+          if (numVariables < RICH_HTTP_MAX_PATH_VARIABLES) {
+            types[numVariables] = Parse::typeAt(pattern, Parse::nameEnd(pattern, i));
+          }
+          ++numVariables;
+          inVariable = true;
+        } else if (pattern[i] == '/') {
+          inVariable = false;
+        }
+
+        // '<' is only special in a variable, so static segments are kept as they were
+        size_t next = inVariable ? Parse::skipType(pattern, i) : i;
+
+        if (next != i) {
+          i = next;
+        } else {
+          stripped += pattern[i++];
+        }
+      }
+
+      return stripped;
+    }
+
+    std::shared_ptr<TokenIterator> patternTokens(const char* pattern, uint8_t numVariables) {
+      if (numVariables == 0) {
+        static std::shared_ptr<TokenIterator> empty = std::make_shared<TokenIterator>("", 0, '/');
+        return empty;
+      }
+
+      return std::make_shared<TokenIterator>(pattern, strlen(pattern), '/');
+    }
+  };
+};
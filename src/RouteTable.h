@@ -0,0 +1,374 @@
+#pragma once
+
+#include <Arduino.h>
+#include <TokenIterator.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+#include "HeapStats.h"
+#include "RouteMethods.h"
+#include "PathValues.h"
+#include "RateLimiter.h"
+
+// Declarative alternative to buildHandler().  Routes are declared as a constexpr
+// table, and their paths are validated and parsed at compile time:
+//
+//   using Route = RichHttp::Route<RichHttpConfig>;
+//
+//   static constexpr Route ROUTES[] PROGMEM = {
+//     Route(HTTP_GET, "/about", handleAbout, true),
+//     Route(HTTP_GET, "/things/:thing_id<uint>", handleGetThing),
+//     Route(HTTP_PUT, "/things/:thing_id<uint>", handlePutThing, false, &thingsLimiter),
+//   };
+//
+//   server.addRoutes(ROUTES);
+//
+// The whole table, including path strings, lives in flash.  Registering it costs a
+// single handler allocation regardless of the number of routes.
+
+// Longest path (including the terminating NUL, excluding variable types) that can be stored
+// in a Route.  Longer paths are rejected at compile time.
+#ifndef RICH_HTTP_ROUTE_MAX_PATH_LENGTH
+#define RICH_HTTP_ROUTE_MAX_PATH_LENGTH 48
+#endif
+
+namespace RichHttp {
+  // Defined in RichHttpServer.h, once each platform's method constants are available.
+  template <class THttpMethod>
+  const char* methodName(THttpMethod method);
+
+  namespace Routes {
+    // Compile-time helpers.  These are limited to single return statements so they're
+    // usable as C++11 constexpr functions.
+    namespace Parse {
+      template <size_t... Is>
+      struct Indices { };
+
+      template <size_t N, size_t... Is>
+      struct MakeIndices : MakeIndices<N - 1, N - 1, Is...> { };
+
+      template <size_t... Is>
+      struct MakeIndices<0, Is...> {
+        using type = Indices<Is...>;
+      };
+
+      constexpr bool isSegmentStart(const char* path, size_t i) {
+        return path[i] != '/' && path[i] != 0 && (i == 0 || path[i - 1] == '/');
+      }
+
+      constexpr uint8_t countVariables(const char* path, size_t i = 0) {
+        return path[i] == 0 ? 0 : (isSegmentStart(path, i) && path[i] == ':' ? 1 : 0) + countVariables(path, i + 1);
+      }
+
+      // A variable must have a name, i.e. ':' can't be followed by '/', a type or the end.
+      constexpr bool hasEmptyVariable(const char* path, size_t i = 0) {
+        return path[i] != 0
+          && ((isSegmentStart(path, i) && path[i] == ':' && (path[i + 1] == '/' || path[i + 1] == '<' || path[i + 1] == 0))
+            || hasEmptyVariable(path, i + 1));
+      }
+
+      // Index of the '>' closing a type opened at i, or of the terminator if it's unclosed
+      constexpr size_t typeEnd(const char* path, size_t i) {
+        return path[i] == 0 || path[i] == '>' ? i : typeEnd(path, i + 1);
+      }
+
+      // Index following a type which starts at i, or i if there isn't one
+      constexpr size_t skipType(const char* path, size_t i) {
+        return path[i] == '<' && path[typeEnd(path, i)] == '>' ? typeEnd(path, i) + 1 : i;
+      }
+
+      // Whether path[i..] is name followed by '>'
+      constexpr bool typeIs(const char* path, size_t i, const char* name) {
+        return *name == 0 ? path[i] == '>' : (path[i] == *name && typeIs(path, i + 1, name + 1));
+      }
+
+      constexpr PathVariableType typeAt(const char* path, size_t i) {
+        return path[i] != '<' ? PathVariableType::STRING
+          : typeIs(path, i + 1, "int") ? PathVariableType::INT
+          : typeIs(path, i + 1, "uint") ? PathVariableType::UINT
+          : typeIs(path, i + 1, "float") ? PathVariableType::FLOAT
+          : PathVariableType::INVALID;
+      }
+
+      // Index of the ':' starting the v-th variable, or of the terminator
+      constexpr size_t variableStart(const char* path, size_t v, size_t i = 0) {
+        return path[i] == 0 ? i
+          : !(isSegmentStart(path, i) && path[i] == ':') ? variableStart(path, v, i + 1)
+          : v == 0 ? i
+          : variableStart(path, v - 1, i + 1);
+      }
+
+      // Index of the type, '/' or terminator ending a variable's name
+      constexpr size_t nameEnd(const char* path, size_t i) {
+        return path[i] == 0 || path[i] == '/' || path[i] == '<' ? i : nameEnd(path, i + 1);
+      }
+
+      constexpr PathVariableType variableType(const char* path, size_t v) {
+        return path[variableStart(path, v)] == 0 ? PathVariableType::STRING : typeAt(path, nameEnd(path, variableStart(path, v)));
+      }
+
+      // A type must be known, follow a variable's name, and end its segment.
+      constexpr bool hasInvalidType(const char* path, size_t i = 0, bool inVariable = false) {
+        return path[i] == 0 ? false
+          : path[i] == '/' ? hasInvalidType(path, i + 1, false)
+          : isSegmentStart(path, i) && path[i] == ':' ? hasInvalidType(path, i + 1, true)
+          : path[i] != '<' ? hasInvalidType(path, i + 1, inVariable)
+          : !inVariable
+            || typeAt(path, i) == PathVariableType::INVALID
+            || (path[typeEnd(path, i) + 1] != '/' && path[typeEnd(path, i) + 1] != 0)
+            || hasInvalidType(path, typeEnd(path, i) + 1, false);
+      }
+
+      // Index in path of the i-th character once types are removed, or of the terminator
+      constexpr size_t sourceIndex(const char* path, size_t i, size_t j = 0) {
+        return path[skipType(path, j)] == 0 || i == 0 ? skipType(path, j) : sourceIndex(path, i - 1, skipType(path, j) + 1);
+      }
+
+      constexpr char strippedCharAt(const char* path, size_t i) {
+        return path[sourceIndex(path, i)];
+      }
+
+      constexpr size_t strippedLength(const char* path, size_t j = 0) {
+        return path[skipType(path, j)] == 0 ? 0 : 1 + strippedLength(path, skipType(path, j) + 1);
+      }
+
+      constexpr bool isValid(const char* path) {
+        return path[0] == '/'
+          && !hasEmptyVariable(path)
+          && !hasInvalidType(path)
+          && strippedLength(path) < RICH_HTTP_ROUTE_MAX_PATH_LENGTH
+          && countVariables(path) <= RICH_HTTP_MAX_PATH_VARIABLES;
+      }
+
+      // Intentionally never defined.  checkPath() only calls it for an invalid path, which
+      // is not allowed during constant evaluation, so declaring a bad route in a constexpr
+      // table fails to compile (or to link, if the table isn't constexpr).
+      const char* invalidRoutePath(const char* path);
+
+      constexpr const char* checkPath(const char* path) {
+        return isValid(path) ? path : invalidRoutePath(path);
+      }
+    };
+
+    /**
+     * Checks a request path against a route pattern.  Segments beginning with ':' match
+     * any non-empty segment.  Repeated and trailing slashes are ignored.  The pattern must
+     * be in RAM.
+     *
+     * If types is non-null, the pattern must not contain types, and the value of each
+     * variable must be valid for its entry in types.  Valid values are stored in values if
+     * it's non-null.
+     */
+    bool matches(
+      const char* pattern,
+      const char* path,
+      size_t length,
+      const PathVariableType* types = nullptr,
+      PathValues* values = nullptr
+    );
+
+    /**
+     * Splits a pattern which may contain variable types (e.g. "/things/:id<uint>") into the
+     * pattern without them and the type of each variable.  Used for patterns registered at
+     * runtime.  types must have room for RICH_HTTP_MAX_PATH_VARIABLES entries.
+     */
+    String parsePattern(const char* pattern, PathVariableType* types);
+
+    /**
+     * Tokens for a route's pattern, used to construct UrlTokenBindings for a request.  For
+     * routes without variables, a shared empty pattern is returned to avoid allocating.
+     */
+    std::shared_ptr<TokenIterator> patternTokens(const char* pattern, uint8_t numVariables);
+  };
+
+  /**
+   * A single entry in a route table.  Construct in a constexpr context so the path is
+   * parsed at compile time.
+   */
+  template <class Config>
+  struct Route {
+    using handler_type = void (*)(typename Config::RequestContextType&);
+
+    template <size_t N>
+    constexpr Route(
+      typename Config::HttpMethod method,
+      const char (&path)[N],
+      handler_type handler,
+      bool disableAuth = false,
+      RateLimiter* rateLimiter = nullptr
+    ) : Route(
+          method,
+          Routes::Parse::checkPath(path),
+          handler,
+          disableAuth,
+          rateLimiter,
+          typename Routes::Parse::MakeIndices<RICH_HTTP_ROUTE_MAX_PATH_LENGTH>::type(),
+          typename Routes::Parse::MakeIndices<RICH_HTTP_MAX_PATH_VARIABLES>::type()
+        )
+    { }
+
+    Route() = default;
+
+    typename Config::HttpMethod method;
+    handler_type handler;
+    bool disableAuth;
+    // Checked before authentication, like HandlerBuilder::setRateLimiter()
+    RateLimiter* rateLimiter;
+    uint8_t numVariables;
+    // Without variable types
+    char path[RICH_HTTP_ROUTE_MAX_PATH_LENGTH];
+    PathVariableType types[RICH_HTTP_MAX_PATH_VARIABLES];
+
+  private:
+    template <size_t... Is, size_t... Vs>
+    constexpr Route(
+      typename Config::HttpMethod method,
+      const char* path,
+      handler_type handler,
+      bool disableAuth,
+      RateLimiter* rateLimiter,
+      Routes::Parse::Indices<Is...>,
+      Routes::Parse::Indices<Vs...>
+    ) : method(method)
+      , handler(handler)
+      , disableAuth(disableAuth)
+      , rateLimiter(rateLimiter)
+      , numVariables(Routes::Parse::countVariables(path))
+      , path{ Routes::Parse::strippedCharAt(path, Is)... }
+      , types{ Routes::Parse::variableType(path, Vs)... }
+    { }
+  };
+
+  /**
+   * Matches requests against a table of Routes, which may be stored in PROGMEM.  Used by
+   * each platform's route table handler.
+   */
+  template <class Config>
+  class RouteTable : public RouteMethods::Source {
+    public:
+      RouteTable(const Route<Config>* routes, size_t numRoutes)
+        : routes(routes)
+        , numRoutes(numRoutes)
+        , pathMethods(new uint8_t[numRoutes]())
+      {
+        // Methods of every route with the same path as each route, so HEAD requests don't
+        // need to check the whole table
+        Route<Config> route;
+        Route<Config> other;
+
+        for (size_t i = 0; i < numRoutes; ++i) {
+          memcpy_P(&route, &routes[i], sizeof(route));
+
+          for (size_t j = 0; j < numRoutes; ++j) {
+            memcpy_P(&other, &routes[j], sizeof(other));
+
+            if (strcmp(route.path, other.path) == 0 && memcmp(route.types, other.types, sizeof(route.types)) == 0) {
+              pathMethods[i] |= methodBit(other.method);
+            }
+          }
+        }
+
+#if defined(RICH_HTTP_HEAP_STATS)
+        stats.reset(new RouteHeapStats*[numRoutes]);
+
+        for (size_t i = 0; i < numRoutes; ++i) {
+          Route<Config> route = at(i);
+          stats[i] = HeapStats::registerRoute(route.path, methodName(route.method));
+        }
+#endif
+      }
+
+      // Copies the entry out of flash.
+      Route<Config> at(size_t index) const {
+        Route<Config> route;
+        memcpy_P(&route, &routes[index], sizeof(route));
+        return route;
+      }
+
+      /**
+       * Finds the first route matching the request and copies it into route.  Returns the
+       * route's index, or -1 if none matched.
+       */
+      int find(
+        typename Config::HttpMethod anyMethod,
+        typename Config::HttpMethod method,
+        const char* path,
+        size_t length,
+        Route<Config>& route,
+        PathValues* values = nullptr
+      ) const {
+        for (size_t i = 0; i < numRoutes; ++i) {
+          memcpy_P(&route, &routes[i], sizeof(route));
+
+          if ((route.method == anyMethod || route.method == method)
+            && Routes::matches(route.path, path, length, route.types, values)) {
+            return static_cast<int>(i);
+          }
+        }
+
+        return -1;
+      }
+
+      /**
+       * Like find(), for a HEAD request.  GET routes match too, unless the table has a HEAD
+       * route for the same path.
+       */
+      int findHead(
+        typename Config::HttpMethod anyMethod,
+        typename Config::HttpMethod headMethod,
+        typename Config::HttpMethod getMethod,
+        const char* path,
+        size_t length,
+        Route<Config>& route,
+        PathValues* values = nullptr
+      ) const {
+        for (size_t i = 0; i < numRoutes; ++i) {
+          memcpy_P(&route, &routes[i], sizeof(route));
+
+          bool methodMatches = route.method == anyMethod
+            || route.method == headMethod
+            || (route.method == getMethod && RouteMethods::servesHeadAsGet(pathMethods[i]));
+
+          if (methodMatches && Routes::matches(route.path, path, length, route.types, values)) {
+            return static_cast<int>(i);
+          }
+        }
+
+        return -1;
+      }
+
+      virtual uint8_t methodsFor(const char* path, size_t length) const override {
+        Route<Config> route;
+        uint8_t methods = 0;
+
+        for (size_t i = 0; i < numRoutes; ++i) {
+          memcpy_P(&route, &routes[i], sizeof(route));
+
+          if (Routes::matches(route.path, path, length, route.types)) {
+            methods |= methodBit(route.method);
+          }
+        }
+
+        return methods;
+      }
+
+      RouteHeapStats* statsFor(size_t index) const {
+#if defined(RICH_HTTP_HEAP_STATS)
+        return stats[index];
+#else
+        return nullptr;
+#endif
+      }
+
+    private:
+      const Route<Config>* routes;
+      size_t numRoutes;
+      std::unique_ptr<uint8_t[]> pathMethods;
+
+#if defined(RICH_HTTP_HEAP_STATS)
+      std::unique_ptr<RouteHeapStats*[]> stats;
+#endif
+  };
+};
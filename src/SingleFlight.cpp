@@ -0,0 +1,152 @@
+#include "SingleFlight.h"
+#include "FieldSelection.h"
+
+#include <string.h>
+
+namespace RichHttp {
+  /**
+   * Body serialized once and sent to every request sharing it
+   */
+  class SharedBody : public BodyWriter {
+    public:
+      virtual void writeTo(Print& out) const override {
+        out.write(reinterpret_cast<const uint8_t*>(body.c_str()), body.length());
+      }
+
+      virtual size_t length() const override {
+        return body.length();
+      }
+
+      String body;
+  };
+
+  SingleFlight::SingleFlight()
+    : hits(0)
+    , misses(0)
+  { }
+
+  String SingleFlight::key(const char* pattern, const UrlTokenBindings& pathVariables, QueryParams& queryParams) {
+    String key;
+    char name[32];
+
+    // The pattern with each variable replaced by its value, i.e. the request's path
+    while (*pattern != 0) {
+      const char* end = strchr(pattern + 1, '/');
+      size_t length = end != nullptr ? end - pattern : strlen(pattern);
+
+      if (pattern[1] == ':') {
+        // Typed variables are bound by their name alone
+        const char* type = static_cast<const char*>(memchr(pattern, '<', length));
+        size_t nameLength = std::min((type != nullptr ? type - pattern : length) - 2, sizeof(name) - 1);
+
+        memcpy(name, pattern + 2, nameLength);
+        name[nameLength] = 0;
+
+        const char* value = pathVariables.get(name);
+        key += '/';
+        key += value != nullptr ? value : "";
+      } else {
+        key.concat(pattern, length);
+      }
+
+      pattern += length;
+    }
+
+    for (size_t i = 0; i < queryParams.size(); ++i) {
+      key += i == 0 ? '?' : '&';
+      key += queryParams.nameAt(i);
+      key += '=';
+      key += queryParams.valueAt(i);
+    }
+
+    return key;
+  }
+
+  bool SingleFlight::replay(const String& key, Response& response) {
+    for (Entry& entry : entries) {
+      if (entry.body != nullptr && ! isLive(entry)) {
+        entry = Entry();
+      } else if (entry.body != nullptr && entry.key == key) {
+        response.sendStream(entry.code, entry.type.c_str(), entry.body);
+
+        for (const std::pair<String, String>& header : entry.headers) {
+          response.addHeader(header.first, header.second);
+        }
+
+        ++hits;
+        return true;
+      }
+    }
+
+    ++misses;
+    return false;
+  }
+
+  void SingleFlight::record(const String& key, Response& response, QueryParams& queryParams) {
+    std::shared_ptr<BodyWriter> body;
+
+    // Errors may be specific to the request which caused them
+    if (response.getCode() < 200 || response.getCode() >= 300) {
+      return;
+    }
+
+    // Replace the entry for this key, or one which has finished sending.  If every entry is
+    // still being sent, the response isn't shared.
+    Entry* slot = nullptr;
+
+    for (Entry& entry : entries) {
+      if (entry.key == key) {
+        slot = &entry;
+        break;
+      }
+
+      if (slot == nullptr && ! isLive(entry)) {
+        slot = &entry;
+      }
+    }
+
+    if (slot == nullptr) {
+      return;
+    }
+
+    if (response.isSetStream()) {
+      body = response.getBodyWriter();
+    } else if (response.isSetBuffer()) {
+      return;
+    } else if (response.isSetBody() || ! response.json.isNull()) {
+      std::shared_ptr<SharedBody> serialized = std::make_shared<SharedBody>();
+
+      if (response.isSetBody()) {
+        serialized->body = response.getBody();
+      } else {
+        FieldSelection selection(response.json.as<JsonVariantConst>());
+        StringPrint dest(serialized->body);
+
+        if (selection.select(queryParams.get(RICH_HTTP_FIELDS_PARAM))) {
+          selection.writeTo(dest);
+        } else {
+          serializeJson(response.json, dest);
+        }
+      }
+
+      String type = response.isSetBody() ? response.getBodyType() : String(F("application/json"));
+
+      // Sent as a stream, which every waiting response shares
+      response.sendStream(response.getCode(), type.c_str(), serialized);
+      body = serialized;
+    } else {
+      return;
+    }
+
+    slot->key = key;
+    slot->code = response.getCode();
+    slot->type = response.getBodyType();
+    slot->body = body;
+    slot->headers = response.getHeaders();
+  }
+
+  bool SingleFlight::isLive(const Entry& entry) {
+    // Responses waiting to be sent hold a reference to the body
+    return entry.body != nullptr && entry.body.use_count() > 1;
+  }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <UrlTokenBindings.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "QueryParams.h"
+#include "RichResponse.h"
+
+// Number of distinct requests a SingleFlight remembers at once
+#ifndef RICH_HTTP_SINGLE_FLIGHT_ENTRIES
+#define RICH_HTTP_SINGLE_FLIGHT_ENTRIES 4
+#endif
+
+namespace RichHttp {
+  /**
+   * Shares one handler execution and one serialized body between identical GET requests
+   * (same path, path variables and query string) which arrive together, e.g. several
+   * dashboards polling the same route.  A response is only shared while it's still being sent
+   * to another client, so a request never gets a response produced before a change it could
+   * have seen.  The builtin server finishes each response before reading the next request,
+   * so in practice only the async server shares responses.
+   *
+   * JSON and raw bodies are serialized once into a buffer which every waiting response
+   * streams from.  Streamed bodies are shared as is.  Only 2xx responses are shared.
+   * Responses sent with sendBuffer() aren't, since the buffer isn't guaranteed to outlive the
+   * handler.
+   */
+  class SingleFlight {
+    public:
+      SingleFlight();
+
+      // Identifies a request to the route with the given pattern
+      static String key(const char* pattern, const UrlTokenBindings& pathVariables, QueryParams& queryParams);
+
+      // Fills response with the response to an identical request which is still being sent,
+      // if there is one.  Frees bodies which have finished sending.
+      bool replay(const String& key, Response& response);
+
+      // Shares response with identical requests while it's being sent.  JSON bodies are
+      // serialized with the fields selected by queryParams.
+      void record(const String& key, Response& response, QueryParams& queryParams);
+
+      inline uint32_t getHits() const { return hits; }
+      inline uint32_t getMisses() const { return misses; }
+
+    private:
+      struct Entry {
+        String key;
+        int code;
+        String type;
+        std::shared_ptr<BodyWriter> body;
+        std::vector<std::pair<String, String>> headers;
+      };
+
+      Entry entries[RICH_HTTP_SINGLE_FLIGHT_ENTRIES];
+      uint32_t hits;
+      uint32_t misses;
+
+      // True if entry's response is still being sent, and so can be shared
+      static bool isLive(const Entry& entry);
+  };
+
+  /**
+   * Handler which runs fn only if there's no response to share from an identical request
+   */
+  template <class Fn>
+  struct SingleFlightFn {
+    Fn fn;
+    SingleFlight* singleFlight;
+    String pattern;
+
+    template <class TContext>
+    void operator()(TContext& request) {
+      String key = SingleFlight::key(pattern.c_str(), request.pathVariables, request.queryParams);
+
+      if (! singleFlight->replay(key, request.response)) {
+        fn(request);
+        singleFlight->record(key, request.response, request.queryParams);
+      }
+    }
+  };
+};
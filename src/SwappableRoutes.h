@@ -0,0 +1,223 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if ! defined(ESP8266)
+#include <atomic>
+#endif
+
+#include "RouteTable.h"
+#include "RouteMethods.h"
+
+// First access log id of routes in tables shared between servers, which number their routes
+// on their own.  Kept clear of the ids each server assigns.
+#ifndef RICH_HTTP_SHARED_ROUTE_IDS
+#define RICH_HTTP_SHARED_ROUTE_IDS 0x8000
+#endif
+
+namespace RichHttp {
+  /**
+   * A route table which can be replaced while the server is running, e.g. to turn features
+   * on and off.  The replacement is built off to the side and published with a single
+   * pointer swap, so requests see either the old table or the new one.
+   *
+   * Dispatching pins the current table with an atomic counter rather than a lock.  Replaced
+   * tables are retired, and freed by reclaim() once no request is using them, so a handler
+   * can swap the table it was dispatched from.
+   *
+   * swap() and reclaim() must be called from one task, e.g. the sketch's loop() or a
+   * handler on the builtin server.
+   *
+   * Routes are identified in the access log by their position in the table, so a route
+   * keeps its id across swaps if it stays in the same place.  A table gets a block of ids
+   * when it's first swapped in, which later generations reuse, and only takes a new block
+   * when a larger table is swapped in.
+   *
+   * A table constructed on its own can be attached to several servers (e.g. one per port)
+   * with RichHttpServer::attachRoutes().  The servers share the routes, and each checks
+   * requests with its own auth provider and middleware.  It must outlive the servers.
+   */
+  template <class Config>
+  class SwappableRoutes : public RouteMethods::Source {
+    public:
+      struct Generation {
+        Generation(const Route<Config>* routes, size_t numRoutes, uint16_t firstRouteId)
+          : table(routes, numRoutes)
+          , firstRouteId(firstRouteId)
+        { }
+
+        Generation(std::vector<Route<Config>>&& owned, uint16_t firstRouteId)
+          : owned(std::move(owned))
+          , table(this->owned.data(), this->owned.size())
+          , firstRouteId(firstRouteId)
+        { }
+
+        // Routes built at runtime, if the table owns them
+        std::vector<Route<Config>> owned;
+        RouteTable<Config> table;
+        uint16_t firstRouteId;
+      };
+
+      /**
+       * Keeps the current generation alive while a request is being dispatched
+       */
+      class Pin {
+        public:
+          Pin(const SwappableRoutes& routes)
+            : routes(routes)
+            , generation(routes.acquire())
+          { }
+
+          ~Pin() {
+            routes.release();
+          }
+
+          // Null if no table has been swapped in
+          inline const Generation* get() const { return generation; }
+
+        private:
+          const SwappableRoutes& routes;
+          const Generation* generation;
+      };
+
+      // Route ids for the access log are allocated from nextRouteId as tables are swapped in
+      SwappableRoutes(uint16_t& nextRouteId)
+        : ownRouteIds(0)
+        , nextRouteId(nextRouteId)
+        , firstRouteId(0)
+        , reservedRouteIds(0)
+        , current(nullptr)
+        , readers(0)
+      { }
+
+      // A table to share between servers, which allocates its own route ids
+      SwappableRoutes()
+        : ownRouteIds(RICH_HTTP_SHARED_ROUTE_IDS)
+        , nextRouteId(ownRouteIds)
+        , firstRouteId(0)
+        , reservedRouteIds(0)
+        , current(nullptr)
+        , readers(0)
+      { }
+
+      SwappableRoutes(const SwappableRoutes&) = delete;
+      SwappableRoutes& operator=(const SwappableRoutes&) = delete;
+
+      ~SwappableRoutes() {
+        delete current;
+
+        for (Generation* generation : retired) {
+          delete generation;
+        }
+      }
+
+      // Replaces the table with routes, which must outlive it (e.g. a static or PROGMEM array)
+      template <size_t N>
+      void swap(const Route<Config> (&routes)[N]) {
+        swap(routes, N);
+      }
+
+      void swap(const Route<Config>* routes, size_t numRoutes) {
+        publish(new Generation(routes, numRoutes, reserveRouteIds(numRoutes)));
+      }
+
+      // Replaces the table with routes built at runtime, which it takes ownership of
+      void swap(std::vector<Route<Config>>&& routes) {
+        uint16_t firstRouteId = reserveRouteIds(routes.size());
+        publish(new Generation(std::move(routes), firstRouteId));
+      }
+
+      // Unregisters every route in the table
+      void clear() {
+        publish(nullptr);
+      }
+
+      // Frees replaced tables once no request is using them.  Returns the number still
+      // waiting.
+      size_t reclaim() {
+        if (! retired.empty() && readers == 0) {
+          for (Generation* generation : retired) {
+            delete generation;
+          }
+          retired.clear();
+        }
+
+        return retired.size();
+      }
+
+      virtual uint8_t methodsFor(const char* path, size_t length) const override {
+        Pin pin(*this);
+        return pin.get() != nullptr ? pin.get()->table.methodsFor(path, length) : 0;
+      }
+
+    private:
+      uint16_t ownRouteIds;
+      uint16_t& nextRouteId;
+      // Block of ids shared by every generation
+      uint16_t firstRouteId;
+      size_t reservedRouteIds;
+      std::vector<Generation*> retired;
+
+#if defined(ESP8266)
+      // Network callbacks don't preempt loop() on the ESP8266, so plain loads and stores
+      // are enough
+      Generation* volatile current;
+      mutable volatile uint16_t readers;
+
+      inline const Generation* acquire() const {
+        ++readers;
+        return current;
+      }
+
+      inline Generation* exchange(Generation* generation) {
+        Generation* previous = current;
+        current = generation;
+        return previous;
+      }
+#else
+      std::atomic<Generation*> current;
+      mutable std::atomic<uint16_t> readers;
+
+      // A swap which sees no readers after publishing can't race with a request, since the
+      // request's load comes after its increment
+      inline const Generation* acquire() const {
+        readers.fetch_add(1);
+        return current.load();
+      }
+
+      inline Generation* exchange(Generation* generation) {
+        return current.exchange(generation);
+      }
+#endif
+
+      inline void release() const {
+        --readers;
+      }
+
+      // Returns the first of count ids for a generation, reusing the table's block if it's
+      // large enough
+      uint16_t reserveRouteIds(size_t count) {
+        if (count > reservedRouteIds) {
+          firstRouteId = nextRouteId;
+          reservedRouteIds = count;
+          nextRouteId += count;
+        }
+
+        return firstRouteId;
+      }
+
+      void publish(Generation* generation) {
+        Generation* previous = exchange(generation);
+
+        if (previous != nullptr) {
+          retired.push_back(previous);
+        }
+
+        reclaim();
+      }
+  };
+};
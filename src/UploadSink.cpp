@@ -0,0 +1,308 @@
+#include "UploadSink.h"
+
+#include <string.h>
+#include <algorithm>
+#include <new>
+
+namespace RichHttp {
+  UploadSink::UploadSink(fs::FS& fs, const String& path, size_t blockSize)
+    : fs(fs)
+    , path(path)
+    , blockSize(blockSize)
+    , blocks{
+        { .data = nullptr, .length = 0, .state = BlockState::EMPTY },
+        { .data = nullptr, .length = 0, .state = BlockState::EMPTY }
+      }
+    , filling(0)
+    , nextWrite(0)
+    , writing(false)
+    , owner(nullptr)
+    , rejected{}
+    , nextRejected(0)
+    , active(false)
+    , failed(false)
+    , bytes(0)
+    , startedAt(0)
+    , lastChunkAt(0)
+    , elapsed(0)
+    , writeTime(0)
+    , writes(0)
+    , stalls(0)
+#if defined(ESP32)
+    , mux(portMUX_INITIALIZER_UNLOCKED)
+#endif
+  { }
+
+  UploadSink::~UploadSink() {
+    release();
+  }
+
+#if defined(ESP32)
+  void UploadSink::lock() {
+    portENTER_CRITICAL(&mux);
+  }
+
+  void UploadSink::unlock() {
+    portEXIT_CRITICAL(&mux);
+  }
+#else
+  // Network callbacks don't preempt loop() on the ESP8266, so there's nothing to guard
+  void UploadSink::lock() { }
+  void UploadSink::unlock() { }
+#endif
+
+  bool UploadSink::begin(const void* owner) {
+    if (active) {
+      if (owner != this->owner && millis() - lastChunkAt <= RICH_HTTP_UPLOAD_IDLE_TIMEOUT) {
+        if (findRejected(owner) < 0) {
+          rejected[nextRejected] = owner;
+          nextRejected = (nextRejected + 1) % RICH_HTTP_UPLOAD_PENDING_REJECTIONS;
+        }
+        return false;
+      }
+
+      // The same client started over, or the upload was abandoned (e.g. its client
+      // disconnected)
+      abort(this->owner);
+    }
+
+    this->owner = owner;
+    clearRejected(owner);
+    failed = true;
+    bytes = 0;
+    elapsed = 0;
+    writeTime = 0;
+    writes = 0;
+    stalls = 0;
+    startedAt = millis();
+    lastChunkAt = startedAt;
+
+    blocks[0].data = new (std::nothrow) uint8_t[blockSize];
+    blocks[1].data = new (std::nothrow) uint8_t[blockSize];
+
+    if (blocks[0].data == nullptr || blocks[1].data == nullptr) {
+      release();
+      return false;
+    }
+
+    file = fs.open(path.c_str(), "w");
+    if (! file) {
+      release();
+      return false;
+    }
+
+    blocks[0].length = blocks[1].length = 0;
+    blocks[0].state = BlockState::FILLING;
+    blocks[1].state = BlockState::EMPTY;
+    filling = 0;
+    nextWrite = 0;
+    failed = false;
+    active = true;
+
+    return true;
+  }
+
+  bool UploadSink::write(const void* owner, const uint8_t* data, size_t length) {
+    if (! active || owner != this->owner) {
+      return false;
+    }
+
+    lastChunkAt = millis();
+
+    while (length > 0 && ! failed) {
+      Block& block = blocks[filling];
+      size_t copied = std::min(length, blockSize - block.length);
+
+      memcpy(block.data + block.length, data, copied);
+      block.length += copied;
+      bytes += copied;
+      data += copied;
+      length -= copied;
+
+      if (block.length == blockSize) {
+        lock();
+        block.state = BlockState::FULL;
+        unlock();
+
+        filling ^= 1;
+        acquire(blocks[filling]);
+      }
+    }
+
+    return ! failed;
+  }
+
+  bool UploadSink::end(const void* owner) {
+    if (! active || owner != this->owner) {
+      return false;
+    }
+
+    Block& last = blocks[filling];
+    lock();
+    last.state = last.length > 0 ? BlockState::FULL : BlockState::EMPTY;
+    unlock();
+
+    // Wait for loop() to finish a write it may have started, then write what's left
+    while (! failed && (blocks[0].state == BlockState::FULL || blocks[1].state == BlockState::FULL)) {
+      if (! writeNext()) {
+        delay(1);
+      }
+    }
+
+    lock();
+    active = false;
+    unlock();
+
+    while (writing) {
+      delay(1);
+    }
+
+    elapsed = millis() - startedAt;
+    release();
+
+    if (failed) {
+      fs.remove(path.c_str());
+    }
+
+    return ! failed;
+  }
+
+  void UploadSink::abort(const void* owner) {
+    if (! active || owner != this->owner) {
+      return;
+    }
+
+    lock();
+    active = false;
+    failed = true;
+    unlock();
+
+    while (writing) {
+      delay(1);
+    }
+
+    elapsed = millis() - startedAt;
+    release();
+    fs.remove(path.c_str());
+  }
+
+  void UploadSink::loop() {
+    while (writeNext()) { }
+  }
+
+  UploadSink::Result UploadSink::takeResult(const void* owner) {
+    if (clearRejected(owner)) {
+      return Result::BUSY;
+    }
+
+    if (owner != this->owner) {
+      return Result::MISSING;
+    }
+
+    // The request ended without its final chunk
+    abort(owner);
+    this->owner = nullptr;
+
+    return failed ? Result::FAILED : Result::SUCCESS;
+  }
+
+  uint32_t UploadSink::getThroughput() const {
+    uint32_t ms = elapsed > 0 ? elapsed : 1;
+    return static_cast<uint32_t>(static_cast<uint64_t>(bytes) * 1000 / ms);
+  }
+
+  void UploadSink::toJson(JsonObject json) const {
+    json["bytes"] = bytes;
+    json["elapsed_ms"] = elapsed;
+    json["write_ms"] = writeTime / 1000;
+    json["bytes_per_second"] = getThroughput();
+    json["writes"] = writes;
+    // Times the upload handler had to write a block because loop() hadn't
+    json["stalls"] = stalls;
+  }
+
+  bool UploadSink::acquire(Block& block) {
+    while (! failed) {
+      lock();
+      if (block.state == BlockState::EMPTY) {
+        block.state = BlockState::FILLING;
+        unlock();
+        return true;
+      }
+      unlock();
+
+      // Both buffers are full.  block is the older of the two, so it's next to be written.
+      if (writeNext()) {
+        ++stalls;
+      } else {
+        delay(1);
+      }
+    }
+
+    return false;
+  }
+
+  bool UploadSink::writeNext() {
+    lock();
+    Block& block = blocks[nextWrite];
+
+    if (! active || writing || block.state != BlockState::FULL) {
+      unlock();
+      return false;
+    }
+    writing = true;
+    unlock();
+
+    uint32_t start = micros();
+    bool written = file.write(block.data, block.length) == block.length;
+    writeTime += micros() - start;
+    ++writes;
+
+    lock();
+    if (! written) {
+      failed = true;
+    }
+    block.length = 0;
+    block.state = BlockState::EMPTY;
+    nextWrite ^= 1;
+    writing = false;
+    unlock();
+
+    return true;
+  }
+
+  int UploadSink::findRejected(const void* owner) const {
+    if (owner == nullptr) {
+      return -1;
+    }
+
+    for (size_t i = 0; i < RICH_HTTP_UPLOAD_PENDING_REJECTIONS; ++i) {
+      if (rejected[i] == owner) {
+        return i;
+      }
+    }
+
+    return -1;
+  }
+
+  bool UploadSink::clearRejected(const void* owner) {
+    int index = findRejected(owner);
+
+    if (index < 0) {
+      return false;
+    }
+
+    rejected[index] = nullptr;
+    return true;
+  }
+
+  void UploadSink::release() {
+    if (file) {
+      file.close();
+    }
+
+    delete[] blocks[0].data;
+    delete[] blocks[1].data;
+    blocks[0].data = blocks[1].data = nullptr;
+  }
+};
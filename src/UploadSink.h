@@ -0,0 +1,137 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <FS.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#endif
+
+// Size of each of an UploadSink's two buffers, and of the writes it makes to the file.  A
+// multiple of the flash sector size keeps writes sector-aligned.
+#ifndef RICH_HTTP_UPLOAD_BLOCK_SIZE
+#define RICH_HTTP_UPLOAD_BLOCK_SIZE 4096
+#endif
+
+// Milliseconds an upload can go without a chunk before another upload may replace it.  The
+// async server doesn't tell handlers when a client disconnects mid-upload.
+#ifndef RICH_HTTP_UPLOAD_IDLE_TIMEOUT
+#define RICH_HTTP_UPLOAD_IDLE_TIMEOUT 10000
+#endif
+
+// Uploads rejected while another was in progress which are remembered until their requests
+// finish, so they can be told apart from requests without a file.  The async server can
+// receive several at once.
+#ifndef RICH_HTTP_UPLOAD_PENDING_REJECTIONS
+#define RICH_HTTP_UPLOAD_PENDING_REJECTIONS 4
+#endif
+
+namespace RichHttp {
+  /**
+   * Writes uploaded files to a filesystem in sector-sized blocks.  Chunks are copied into one
+   * of two buffers while the other is written, so the network isn't stalled while the
+   * filesystem erases a sector.  Full blocks are written by loop(), which should be called
+   * from the sketch's loop(); a block that hasn't been written by the time its buffer is
+   * needed again is written by the upload handler instead.
+   *
+   * The buffers are allocated when an upload starts and freed when it ends.  One upload is
+   * written at a time: chunks from other requests are ignored while one is in progress, unless
+   * it hasn't received a chunk for RICH_HTTP_UPLOAD_IDLE_TIMEOUT, in which case it's
+   * discarded and the new upload takes its place.
+   */
+  class UploadSink {
+    public:
+      // Uploads are written to path on fs, replacing what's there
+      UploadSink(fs::FS& fs, const String& path, size_t blockSize = RICH_HTTP_UPLOAD_BLOCK_SIZE);
+      ~UploadSink();
+
+      // owner identifies the request the chunks belong to.  Returns false if another upload
+      // is in progress and hasn't gone idle, or the file or buffers couldn't be opened.
+      bool begin(const void* owner);
+      // Returns false if the upload has failed
+      bool write(const void* owner, const uint8_t* data, size_t length);
+      // Writes what's left and closes the file.  Returns false if the upload failed, in
+      // which case the file is removed.
+      bool end(const void* owner);
+      // Discards the upload and removes the file
+      void abort(const void* owner);
+
+      // Writes full blocks from the sketch's loop()
+      void loop();
+
+      enum class Result { SUCCESS, FAILED, BUSY, MISSING };
+
+      // Outcome of owner's upload, once the request has been received.  BUSY if it was
+      // ignored because another upload was in progress, and MISSING if it had no file.  If
+      // more than RICH_HTTP_UPLOAD_PENDING_REJECTIONS uploads are rejected before their
+      // requests finish, the oldest are reported as MISSING.
+      Result takeResult(const void* owner);
+
+      // Statistics for the last upload
+      inline uint32_t getBytes() const { return bytes; }
+      // Milliseconds from the first chunk to the end of the upload
+      inline uint32_t getElapsed() const { return elapsed; }
+      // Sustained throughput of the last upload in bytes per second
+      uint32_t getThroughput() const;
+      void toJson(JsonObject json) const;
+
+    private:
+      enum class BlockState : uint8_t { EMPTY, FILLING, FULL };
+
+      struct Block {
+        uint8_t* data;
+        size_t length;
+        volatile BlockState state;
+      };
+
+      fs::FS& fs;
+      const String path;
+      const size_t blockSize;
+
+      File file;
+      Block blocks[2];
+      // Block chunks are copied into, and the block to be written next
+      uint8_t filling;
+      volatile uint8_t nextWrite;
+      volatile bool writing;
+
+      const void* owner;
+      // Ring of rejected owners, cleared as their results are taken
+      const void* rejected[RICH_HTTP_UPLOAD_PENDING_REJECTIONS];
+      uint8_t nextRejected;
+      bool active;
+      volatile bool failed;
+
+      uint32_t bytes;
+      uint32_t startedAt;
+      uint32_t lastChunkAt;
+      uint32_t elapsed;
+      uint32_t writeTime;
+      uint16_t writes;
+      uint16_t stalls;
+
+#if defined(ESP32)
+      // Upload handlers run on the network task, concurrently with loop()
+      portMUX_TYPE mux;
+#endif
+
+      void lock();
+      void unlock();
+
+      // Claims block for filling, writing it first if it's full
+      bool acquire(Block& block);
+      // Writes the next full block.  Returns false if there isn't one, or another write is
+      // in progress.
+      bool writeNext();
+      // Closes the file and frees the buffers
+      void release();
+      // Index of owner in rejected, or -1
+      int findRejected(const void* owner) const;
+      // Forgets that owner's upload was rejected.  Returns false if it wasn't.
+      bool clearRejected(const void* owner);
+  };
+};
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""
+Generates a delta OTA patch which transforms one firmware image into another.  The
+resulting patch can be uploaded to a route registered with `handleDeltaOTA()` on a
+device currently running the source image.
+
+Usage:
+  delta_patch.py <source.bin> <target.bin> <patch.out>
+
+See src/DeltaUpdate.h for a description of the patch format.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"RHDP"
+VERSION = 1
+
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+# Length of the key used to find candidate matches in the source image
+BLOCK_SIZE = 8
+# Shorter matches cost more to encode than they save
+MIN_MATCH = 12
+# Bound the number of candidates considered per target offset
+MAX_CANDIDATES = 16
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        b = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def zigzag(value):
+    return (value << 1) ^ (value >> 63)
+
+
+def index_source(source):
+    index = {}
+    for i in range(len(source) - BLOCK_SIZE + 1):
+        candidates = index.setdefault(source[i:i + BLOCK_SIZE], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(i)
+    return index
+
+
+def match_length(source, src_pos, target, tgt_pos):
+    n = 0
+    limit = min(len(source) - src_pos, len(target) - tgt_pos)
+    while n < limit and source[src_pos + n] == target[tgt_pos + n]:
+        n += 1
+    return n
+
+
+def build_patch(source, target):
+    index = index_source(source)
+    ops = bytearray()
+    literal = bytearray()
+    source_position = 0
+    i = 0
+
+    def flush_literal():
+        if literal:
+            ops.append(OP_INSERT)
+            ops.extend(varint(len(literal)))
+            ops.extend(literal)
+            literal.clear()
+
+    while i < len(target):
+        # Prefer continuing where the previous copy ended; this is the common case for
+        # unchanged code following a small edit.
+        best_pos, best_len = source_position, 0
+        if source_position < len(source):
+            best_len = match_length(source, source_position, target, i)
+
+        for candidate in index.get(target[i:i + BLOCK_SIZE], ()):
+            length = match_length(source, candidate, target, i)
+            if length > best_len:
+                best_pos, best_len = candidate, length
+
+        if best_len >= MIN_MATCH:
+            flush_literal()
+            ops.append(OP_COPY)
+            ops.extend(varint(zigzag(best_pos - source_position)))
+            ops.extend(varint(best_len))
+            source_position = best_pos + best_len
+            i += best_len
+        else:
+            literal.append(target[i])
+            i += 1
+
+    flush_literal()
+
+    header = MAGIC + struct.pack("<B3xII", VERSION, len(source), len(target)) + hashlib.md5(target).digest()
+    return header + bytes(ops)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate a delta OTA patch")
+    parser.add_argument("source", help="Firmware image currently running on the device")
+    parser.add_argument("target", help="New firmware image")
+    parser.add_argument("patch", help="Output patch file")
+    args = parser.parse_args()
+
+    with open(args.source, "rb") as f:
+        source = f.read()
+    with open(args.target, "rb") as f:
+        target = f.read()
+
+    patch = build_patch(source, target)
+
+    with open(args.patch, "wb") as f:
+        f.write(patch)
+
+    print(
+        "Wrote %d byte patch (%.1f%% of %d byte target)" % (len(patch), 100.0 * len(patch) / max(len(target), 1), len(target)),
+        file=sys.stderr
+    )
+
+
+if __name__ == "__main__":
+    main()